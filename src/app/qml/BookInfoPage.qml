@@ -7,6 +7,7 @@ import QtQuick.Layouts
 import org.kde.kirigami as Kirigami
 import org.kde.peruse as Peruse
 import org.kde.kirigamiaddons.formcard as FormCard
+import "listcomponents" as ListComponents
 
 FormCard.FormCardPage {
     id: root
@@ -16,11 +17,10 @@ FormCard.FormCardPage {
     property var tags: peruseConfig.getFilesystemProperty(root.bookEntry.filename, "tags").split(",")
     property int rating: peruseConfig.getFilesystemProperty(root.bookEntry.filename, "rating")
 
-    Kirigami.Icon {
+    ListComponents.BookCover {
         id: coverImage;
 
-        source: root.bookEntry.thumbnail
-        placeholder: "application-vnd.oasis.opendocument.text"
+        cover: root.bookEntry.thumbnail
         fallback: "paint-unknown"
 
         Layout.alignment: Qt.AlignHCenter
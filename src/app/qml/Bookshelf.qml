@@ -122,6 +122,9 @@ Kirigami.ScrollablePage {
         }
         keyNavigationEnabled: true;
         clip: true;
+        // Create the tiles a couple of screenfuls either side of what is shown, so their covers can
+        // be made ahead of time (see BookCover, which makes those on screen first)
+        cacheBuffer: height * 2;
 
         Kirigami.PlaceholderMessage {
             id: placeholderMessage
@@ -81,6 +81,7 @@ Kirigami.ApplicationWindow {
         id: contentList;
         contentModel: ContentList {
             autoSearch: false
+            watchLocations: true
 
             onSearchStarted: { mainWindow.isLoading = true; }
             onSearchCompleted: { mainWindow.isLoading = false; }
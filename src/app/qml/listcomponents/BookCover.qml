@@ -0,0 +1,95 @@
+// SPDX-FileCopyrightText: 2026 Peruse contributors
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+import QtQuick
+
+import org.kde.kirigami as Kirigami
+import org.kde.peruse.thumbnail as Thumbnail
+
+/**
+ * @brief A book's cover, as found in the thumbnail role of the book models.
+ *
+ * Covers served from the cover atlas (image://atlascover/) are followed by the url of the
+ * book's usual thumbnail, and should the atlas turn out not to have the cover after all,
+ * the cover is fetched from there instead.
+ *
+ * Given the view it is shown in, the cover also lets the thumbnail scheduler know how soon it
+ * is wanted: straight away when on screen, next when within a screenful of the visible part of
+ * the view, and after that otherwise.
+ */
+Kirigami.Icon {
+    id: root;
+
+    /**
+     * \property BookCover::cover
+     * \brief The url of the cover to show
+     */
+    property string cover;
+
+    // Whether the atlas did not have the cover
+    property bool atlasMissed: false;
+    readonly property string atlasPrefix: "image://atlascover/";
+
+    onCoverChanged: atlasMissed = false;
+    onStatusChanged: {
+        if (status === Kirigami.Icon.Error && cover.startsWith(atlasPrefix)) {
+            atlasMissed = true;
+        }
+    }
+
+    /**
+     * \property BookCover::view
+     * \brief The view the cover is shown in, if any
+     */
+    property Flickable view: null;
+    /**
+     * \property BookCover::tile
+     * \brief The item in the view's content the cover is part of, whose position in the view is used
+     */
+    property Item tile: null;
+
+    readonly property int priority: {
+        if (!view || !tile) {
+            return Thumbnail.ThumbnailScheduler.Visible;
+        }
+        const distance = Math.max(view.contentY - (tile.y + tile.height), tile.y - (view.contentY + view.height));
+        if (distance <= 0) {
+            return Thumbnail.ThumbnailScheduler.Visible;
+        } else if (distance <= view.height) {
+            return Thumbnail.ThumbnailScheduler.NearViewport;
+        }
+        return Thumbnail.ThumbnailScheduler.Speculative;
+    }
+    // The id the image provider is asked for the cover by, which is what the scheduler knows it by.
+    // Covers from the atlas are never scheduled, so those have none.
+    readonly property string requestId: {
+        const url = source ? source.toString() : "";
+        if (!url.startsWith("image://") || url.startsWith(atlasPrefix)) {
+            return "";
+        }
+        return url.substring(url.indexOf("/", 8) + 1);
+    }
+    property string prioritisedId;
+
+    function updatePriority() {
+        if (prioritisedId.length > 0 && prioritisedId !== requestId) {
+            Thumbnail.ThumbnailScheduler.setPriority(prioritisedId, Thumbnail.ThumbnailScheduler.Visible);
+        }
+        prioritisedId = requestId;
+        if (requestId.length > 0) {
+            Thumbnail.ThumbnailScheduler.setPriority(requestId, priority);
+        }
+    }
+    onRequestIdChanged: updatePriority();
+    onPriorityChanged: updatePriority();
+    Component.onCompleted: updatePriority();
+    // Visible is the default, so this also has the scheduler forget about the cover
+    Component.onDestruction: {
+        if (prioritisedId.length > 0) {
+            Thumbnail.ThumbnailScheduler.setPriority(prioritisedId, Thumbnail.ThumbnailScheduler.Visible);
+        }
+    }
+
+    source: atlasMissed ? cover.substring(atlasPrefix.length) : cover;
+    placeholder: "application-vnd.oasis.opendocument.text";
+}
@@ -71,7 +71,7 @@ Delegates.RoundedItemDelegate {
                 anchors.fill: coverImage
             }
 
-            Kirigami.Icon {
+            BookCover {
                 id: coverImage
 
                 width: root.width - 2 * Kirigami.Units.largeSpacing
@@ -84,8 +84,9 @@ Delegates.RoundedItemDelegate {
                     margins: Kirigami.Settings.isMobile ? 0 : Kirigami.Units.largeSpacing
                 }
 
-                source: root.thumbnail === "Unknown role" ? "" : root.thumbnail;
-                placeholder: "application-vnd.oasis.opendocument.text";
+                cover: root.thumbnail === "Unknown role" ? "" : root.thumbnail;
+                view: root.GridView.view
+                tile: root
                 fallback: "paint-unknown"
             }
 
@@ -90,14 +90,15 @@ Delegates.RoundedItemDelegate {
                 }
                 radius: 2;
             }
-            Kirigami.Icon {
+            BookCover {
                 id: coverImage;
                 anchors {
                     fill: parent;
                     margins: Kirigami.Units.largeSpacing;
                 }
-                source: root.categoryEntriesModel ? root.categoryEntriesModel.getBookEntry(0).thumbnail : "";
-                placeholder: "application-vnd.oasis.opendocument.text";
+                cover: root.categoryEntriesModel ? root.categoryEntriesModel.getBookEntry(0).thumbnail : "";
+                view: root.GridView.view;
+                tile: root;
                 fallback: "folder-documents-symbolic"
             }
             Rectangle {
@@ -5,36 +5,145 @@
 
 #include <Baloo/File>
 #include <Baloo/IndexerConfig>
+#include <Baloo/Query>
 #include <KFileMetaData/PropertyInfo>
-#include <KFileMetaData/UserMetaData>
 
 #include <QDateTime>
 #include <QFileInfo>
 #include <QList>
 #include <QMimeDatabase>
 #include <QProcess>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QThread>
 #include <QThreadPool>
+#include <QTimer>
+
+#include <atomic>
+#include <memory>
 
 #include "ContentQuery.h"
 
+namespace
+{
+// The number of results checked together by a single worker
+static const int validationBatchSize = 200;
+
+/**
+ * Everything needed to search one location, copied out of the ContentQuery
+ * on the gui thread so the workers never touch the query object itself.
+ */
+struct LocationSearch {
+    Baloo::Query query;
+    QString location;
+    QSet<QString> mimeTypes;
+};
+}
+
 class BalooContentLister::Private
 {
 public:
     Private(BalooContentLister *qq)
         : q(qq)
     {
+        pool.setMaxThreadCount(qMax(2, QThread::idealThreadCount()));
     }
 
     BalooContentLister *q = nullptr;
 
-    Baloo::QueryRunnable *createQuery(ContentQuery *contentQuery, const QString &location = QString{});
+    LocationSearch createSearch(ContentQuery *contentQuery, const QString &location = QString{}) const;
 
-    QStringList locations;
-    QString searchString;
-    QList<Baloo::QueryRunnable *> queries;
-    QList<QString> queryLocations;
+    QThreadPool pool;
+    // Searches and validation batches which have been started but not yet finished
+    std::atomic<int> outstanding{0};
+    std::atomic<bool> aborted{false};
 
-    QMimeDatabase mimeDatabase;
+    void finishTask()
+    {
+        if (--outstanding == 0 && !aborted) {
+            QMetaObject::invokeMethod(
+                q,
+                [this]() {
+                    if (outstanding == 0) {
+                        Q_EMIT q->searchCompleted();
+                    }
+                },
+                Qt::QueuedConnection);
+        }
+    }
+
+    void search(const LocationSearch &search, const std::shared_ptr<const QSet<QString>> &knownFiles)
+    {
+        QStringList batch;
+        Baloo::ResultIterator it = search.query.exec();
+        while (!aborted && it.next()) {
+            const QString file = it.filePath();
+            if (knownFiles->contains(file)) {
+                continue;
+            }
+            batch << file;
+            if (batch.count() >= validationBatchSize) {
+                startValidation(search, batch);
+                batch.clear();
+            }
+        }
+        if (!batch.isEmpty()) {
+            startValidation(search, batch);
+        }
+        finishTask();
+    }
+
+    void startValidation(const LocationSearch &search, const QStringList &files)
+    {
+        ++outstanding;
+        pool.start([this, search, files]() {
+            validate(search, files);
+            finishTask();
+        });
+    }
+
+    void validate(const LocationSearch &search, const QStringList &files)
+    {
+        QMimeDatabase mimeDb;
+        QList<QPair<QString, QVariantMap>> found;
+        for (const QString &file : files) {
+            if (aborted) {
+                return;
+            }
+            // wow, this isn't nice... why is baloo not limiting searches like it's supposed to?
+            if (!file.startsWith(search.location)) {
+                continue;
+            }
+
+            // Like the one above, this is also not nice: apparently Baloo can return results to
+            // files that no longer exist on the file system. So we have to check manually whether
+            // the results provided are actually sensible results...
+            if (!QFileInfo::exists(file)) {
+                continue;
+            }
+
+            // It would be nice if Baloo could do mime type filtering on its own...
+            if (!search.mimeTypes.isEmpty() && !search.mimeTypes.contains(ContentListerBase::mimeTypeForFile(mimeDb, file))) {
+                continue;
+            }
+
+            auto metadata = ContentListerBase::metaDataForFile(file);
+
+            Baloo::File balooFile(file);
+            balooFile.load();
+            const KFileMetaData::PropertyMap properties = balooFile.properties();
+            KFileMetaData::PropertyMap::const_iterator it = properties.constBegin();
+            for (; it != properties.constEnd(); it++) {
+                KFileMetaData::PropertyInfo propInfo(it.key());
+                metadata[propInfo.name()] = it.value();
+            }
+
+            found << qMakePair(file, metadata);
+        }
+        if (!found.isEmpty()) {
+            Q_EMIT q->filesFound(found);
+        }
+    }
 };
 
 BalooContentLister::BalooContentLister(QObject *parent)
@@ -45,106 +154,136 @@ BalooContentLister::BalooContentLister(QObject *parent)
 
 BalooContentLister::~BalooContentLister()
 {
-    QThreadPool::globalInstance()->waitForDone();
+    d->aborted = true;
+    d->pool.clear();
+    d->pool.waitForDone();
+}
+
+namespace
+{
+// How long a check of whether Baloo is enabled is trusted for, in seconds
+static const int balooCheckLifetime = 24 * 60 * 60;
+// How long balooctl gets to answer, in milliseconds
+static const int balooCheckTimeout = 5000;
+
+QString balooCheckCacheFile()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QStringLiteral("/peruse/backends.ini");
 }
 
-bool BalooContentLister::balooEnabled() const
+void rememberBalooEnabled(bool enabled)
+{
+    QSettings cache(balooCheckCacheFile(), QSettings::IniFormat);
+    cache.setValue(QStringLiteral("baloo/enabled"), enabled);
+    cache.setValue(QStringLiteral("baloo/checked"), QDateTime::currentDateTimeUtc());
+}
+}
+
+bool BalooContentLister::cachedBalooEnabled(bool *enabled)
 {
     // Baloo is not intended to be used outside of Plasma sessions
     // and so we can bypass all the testing if we are not actually
     // in a full KDE session.
+    if (!qEnvironmentVariableIsSet("KDE_FULL_SESSION")) {
+        *enabled = false;
+        return true;
+    }
+
+    const QSettings cache(balooCheckCacheFile(), QSettings::IniFormat);
+    const QDateTime checked = cache.value(QStringLiteral("baloo/checked")).toDateTime();
+    if (!checked.isValid() || checked.secsTo(QDateTime::currentDateTimeUtc()) > balooCheckLifetime) {
+        return false;
+    }
+    *enabled = cache.value(QStringLiteral("baloo/enabled"), false).toBool();
+    // Switching indexing off is a setting, and cheap to check, so don't trust a stale yes for that
+    if (*enabled) {
+        Baloo::IndexerConfig config;
+        *enabled = config.fileIndexingEnabled();
+    }
+    return true;
+}
+
+void BalooContentLister::checkBalooEnabled(QObject *context, const std::function<void(bool)> &callback)
+{
     bool result{qEnvironmentVariableIsSet("KDE_FULL_SESSION")};
 
     if (result) {
         Baloo::IndexerConfig config;
         result = config.fileIndexingEnabled();
+    }
 
-        if (result) {
-            // It would be terribly nice with a bit of baloo engine exporting, so
-            // we can ask the database about whether or not it is accessible...
-            // But, this is a catch-all check anyway, so we get a complete "everything's broken"
-            // result if anything is broken... guess it will do :)
-            QProcess statuscheck;
-            statuscheck.start("balooctl", QStringList() << "status");
-            statuscheck.waitForFinished();
-            QString output = statuscheck.readAll();
-            if (statuscheck.exitStatus() == QProcess::CrashExit || statuscheck.exitCode() != 0) {
-                result = false;
-            }
-        }
+    if (!result) {
+        rememberBalooEnabled(false);
+        QMetaObject::invokeMethod(
+            context,
+            [callback]() {
+                callback(false);
+            },
+            Qt::QueuedConnection);
+        return;
     }
 
-    return result;
+    // It would be terribly nice with a bit of baloo engine exporting, so
+    // we can ask the database about whether or not it is accessible...
+    // But, this is a catch-all check anyway, so we get a complete "everything's broken"
+    // result if anything is broken... guess it will do :)
+    auto statuscheck = new QProcess(context);
+    auto timeout = new QTimer(statuscheck);
+    timeout->setSingleShot(true);
+    QObject::connect(timeout, &QTimer::timeout, statuscheck, [statuscheck]() {
+        // Whatever is wrong with it, a Baloo which takes this long to answer is not one we want to rely on
+        statuscheck->kill();
+    });
+    QObject::connect(statuscheck, &QProcess::finished, context, [statuscheck, timeout, callback](int exitCode, QProcess::ExitStatus exitStatus) {
+        const bool enabled = !timeout->isActive() ? false : (exitStatus == QProcess::NormalExit && exitCode == 0);
+        timeout->stop();
+        statuscheck->deleteLater();
+        rememberBalooEnabled(enabled);
+        callback(enabled);
+    });
+    QObject::connect(statuscheck, &QProcess::errorOccurred, context, [statuscheck, timeout, callback](QProcess::ProcessError error) {
+        if (error != QProcess::FailedToStart) {
+            // Everything else is followed by finished()
+            return;
+        }
+        timeout->stop();
+        statuscheck->deleteLater();
+        rememberBalooEnabled(false);
+        callback(false);
+    });
+    statuscheck->start("balooctl", QStringList() << "status");
+    timeout->start(balooCheckTimeout);
 }
 
 void BalooContentLister::startSearch(const QList<ContentQuery *> &queries)
 {
+    QList<LocationSearch> searches;
     for (const auto &query : queries) {
         for (const auto &location : query->locations()) {
-            d->queries.append(d->createQuery(query, location));
+            searches.append(d->createSearch(query, location));
         }
 
         if (query->locations().isEmpty())
-            d->queries.append(d->createQuery(query));
-    }
-
-    if (!d->queries.empty()) {
-        QThreadPool::globalInstance()->start(d->queries.first());
-    }
-}
-
-void BalooContentLister::queryCompleted(Baloo::QueryRunnable *query)
-{
-    d->queries.removeAll(query);
-    if (d->queries.empty()) {
-        emit searchCompleted();
-    } else {
-        QThreadPool::globalInstance()->start(d->queries.first());
-    }
-}
-
-void BalooContentLister::queryResult(const ContentQuery *query, const QString &location, const QString &file)
-{
-    if (knownFiles.contains(file)) {
-        return;
-    }
-
-    // wow, this isn't nice... why is baloo not limiting searches like it's supposed to?
-    if (!file.startsWith(location)) {
-        return;
+            searches.append(d->createSearch(query));
     }
 
-    // Like the one above, this is also not nice: apparently Baloo can return results to
-    // files that no longer exist on the file system. So we have to check manually whether
-    // the results provided are actually sensible results...
-    if (!QFile::exists(file)) {
+    if (searches.isEmpty()) {
+        // There is nothing to look for, but whoever started the search still needs to hear that it is done
+        QMetaObject::invokeMethod(this, &ContentListerBase::searchCompleted, Qt::QueuedConnection);
         return;
     }
 
-    // It would be nice if Baloo could do mime type filtering on its own...
-    if (!query->mimeTypes().isEmpty()) {
-        const auto &mimeType = d->mimeDatabase.mimeTypeForFile(file).name();
-        if (!query->mimeTypes().contains(mimeType))
-            return;
-    }
-
-    auto metadata = metaDataForFile(file);
-
-    Baloo::File balooFile(file);
-    balooFile.load();
-    KFileMetaData::PropertyMap properties = balooFile.properties();
-    KFileMetaData::PropertyMap::const_iterator it = properties.constBegin();
-    for (; it != properties.constEnd(); it++) {
-        KFileMetaData::PropertyInfo propInfo(it.key());
-        metadata[propInfo.name()] = it.value();
+    // Shared between all the searches, rather than copying the whole library for each of them
+    const auto known = std::make_shared<const QSet<QString>>(knownFiles);
+    d->outstanding += searches.count();
+    for (const LocationSearch &search : std::as_const(searches)) {
+        d->pool.start([this, search, known]() {
+            d->search(search, known);
+        });
     }
-
-    qWarning() << metadata;
-
-    emit fileFound(file, metadata);
 }
 
-Baloo::QueryRunnable *BalooContentLister::Private::createQuery(ContentQuery *contentQuery, const QString &location)
+LocationSearch BalooContentLister::Private::createSearch(ContentQuery *contentQuery, const QString &location) const
 {
     auto balooQuery = Baloo::Query{};
     if (!location.isEmpty())
@@ -170,11 +309,6 @@ Baloo::QueryRunnable *BalooContentLister::Private::createQuery(ContentQuery *con
     if (!contentQuery->searchString().isEmpty())
         balooQuery.setSearchString(contentQuery->searchString());
 
-    auto runnable = new Baloo::QueryRunnable{balooQuery};
-    connect(runnable, &Baloo::QueryRunnable::queryResult, q, [this, contentQuery, location](QRunnable *, const QString &file) {
-        q->queryResult(contentQuery, location, file);
-    });
-    connect(runnable, &Baloo::QueryRunnable::finished, q, &BalooContentLister::queryCompleted);
-
-    return runnable;
+    const QStringList mimeTypes = contentQuery->mimeTypes();
+    return LocationSearch{balooQuery, location, QSet<QString>(mimeTypes.constBegin(), mimeTypes.constEnd())};
 }
@@ -6,10 +6,17 @@
 
 #include "ContentListerBase.h"
 
-#include <Baloo/QueryRunnable>
-
 #include <QString>
 
+#include <functional>
+
+/**
+ * \brief A content lister which asks Baloo for the files matching the queries
+ *
+ * The searches for all the query locations run at the same time, and the files they return
+ * are checked (that they still exist, are in the right place, and of the right type) in
+ * batches on worker threads, before being reported through filesFound().
+ */
 class BalooContentLister : public ContentListerBase
 {
     Q_OBJECT
@@ -18,9 +25,26 @@ public:
     ~BalooContentLister() override;
 
     /**
-     * @returns whether Baloo is enabled. If baloo is not available on the system, we cannot use it.
+     * \brief Whether Baloo was usable the last time this was checked, if that was recently enough to trust.
+     *
+     * The result of checkBalooEnabled() is remembered across launches for a day, so on most
+     * launches this can answer straight away, without having to start any processes.
+     *
+     * @param enabled Set to whether Baloo is enabled, if that is known
+     * @returns whether the remembered result is recent enough to be used
      */
-    bool balooEnabled() const;
+    static bool cachedBalooEnabled(bool *enabled);
+    /**
+     * \brief Find out whether Baloo is enabled, without blocking.
+     *
+     * If baloo is not available on the system, we cannot use it. Checking this involves asking
+     * balooctl, which can take a while, and so this is done in the background. If balooctl has
+     * not answered within a few seconds, Baloo is considered unavailable.
+     *
+     * @param context The object the callback belongs to. If this is destroyed, the callback is not called.
+     * @param callback Called on the context object's thread with whether Baloo is enabled
+     */
+    static void checkBalooEnabled(QObject *context, const std::function<void(bool)> &callback);
 
     /**
      * \brief Start a search.
@@ -31,9 +55,6 @@ public:
 private:
     class Private;
     std::unique_ptr<Private> d;
-
-    Q_SLOT void queryCompleted(Baloo::QueryRunnable *query);
-    void queryResult(const ContentQuery *query, const QString &location, const QString &file);
 };
 
 #endif // BALOOCONTENTLISTER_H
@@ -2,12 +2,16 @@
 // SPDX-License-Identifier: LGPL-2.1-only or LGPL-3.0-only or LicenseRef-KDE-Accepted-LGPL
 
 #include "ContentList.h"
-#ifdef HAVE_BALOO
+#ifdef BALOO_FOUND
 #include "BalooContentLister.h"
 #endif
 #include "FilesystemContentLister.h"
+#include "FilesystemWatcher.h"
+
+#include <algorithm>
 
 #include <QDebug>
+#include <QDir>
 #include <QMimeDatabase>
 #include <QSet>
 #include <QTimer>
@@ -31,6 +35,13 @@ public:
     QList<ContentEntry> entries;
     ContentListerBase *actualContentList;
 
+    // Found entries waiting to be added to the model. Adding them in one go every so often
+    // means views and the BookListModel get one insertion for a bunch of files, instead
+    // of one for each and every file.
+    QList<ContentEntry> pendingEntries;
+    QTimer pendingEntriesTimer;
+    static const int maxPendingEntries = 500;
+
     QList<ContentQuery *> queries;
     QueryListProperty listProperty;
 
@@ -39,6 +50,15 @@ public:
     bool autoSearch = false;
     bool cacheResults = false;
     bool completed = false;
+    bool watchLocations = false;
+    // Whether the lister is in the middle of a search
+    bool searching = false;
+
+    FilesystemWatcher *watcher = nullptr;
+    // Gathers up bursts of changes (such as a directory being unpacked) into a single rescan
+    QTimer rescanTimer;
+    // Used in place of the watcher for when there are too many directories to watch them all
+    QTimer fallbackRescanTimer;
 
     static void appendToList(QueryListProperty *property, ContentQuery *value);
     static ContentQuery *listValueAt(QueryListProperty *property, qsizetype index);
@@ -56,20 +76,39 @@ ContentList::ContentList(QObject *parent)
     : QAbstractListModel(parent)
     , d(new Private)
 {
-#ifdef HAVE_BALOO
-    auto baloo = new BalooContentLister(this);
-    if (baloo->balooEnabled()) {
-        d->actualContentList = baloo;
+#ifdef BALOO_FOUND
+    // Finding out whether Baloo works means asking balooctl, which can take a good while,
+    // so unless we remember the answer from a recent launch, the filesystem lister gets to
+    // start out, and Baloo takes over if it turns out to be usable. A search still running
+    // at that point is run again through Baloo, which skips everything already found.
+    bool balooEnabled{false};
+    if (BalooContentLister::cachedBalooEnabled(&balooEnabled)) {
+        if (balooEnabled) {
+            setLister(new BalooContentLister(this));
+        } else {
+            setLister(new FilesystemContentLister(this));
+        }
     } else {
-        baloo->deleteLater();
-        d->actualContentList = new FilesystemContentLister(this);
+        setLister(new FilesystemContentLister(this));
+        BalooContentLister::checkBalooEnabled(this, [this](bool enabled) {
+            if (enabled) {
+                setLister(new BalooContentLister(this));
+            }
+        });
     }
 #else
-    d->actualContentList = new FilesystemContentLister(this);
+    setLister(new FilesystemContentLister(this));
 #endif
 
-    connect(d->actualContentList, &ContentListerBase::fileFound, this, &ContentList::fileFound);
-    connect(d->actualContentList, &ContentListerBase::searchCompleted, this, &ContentList::searchCompleted);
+    d->pendingEntriesTimer.setSingleShot(true);
+    d->pendingEntriesTimer.setInterval(50);
+    connect(&d->pendingEntriesTimer, &QTimer::timeout, this, &ContentList::flushPendingEntries);
+
+    d->rescanTimer.setSingleShot(true);
+    d->rescanTimer.setInterval(2000);
+    connect(&d->rescanTimer, &QTimer::timeout, this, &ContentList::rescan);
+    d->fallbackRescanTimer.setInterval(15 * 60 * 1000);
+    connect(&d->fallbackRescanTimer, &QTimer::timeout, this, &ContentList::rescan);
 
     d->listProperty = QQmlListProperty<ContentQuery>{
         this,
@@ -100,6 +139,11 @@ bool ContentList::cacheResults() const
     return d->cacheResults;
 }
 
+bool ContentList::watchLocations() const
+{
+    return d->watchLocations;
+}
+
 QString ContentList::getMimetype(const QString &filePath)
 {
     QMimeDatabase db;
@@ -112,6 +156,7 @@ void ContentList::startSearch()
     QTimer::singleShot(1, this, [this]() {
         Q_EMIT searchStarted();
         qWarning() << "search started";
+        d->searching = true;
         d->actualContentList->knownFiles = d->knownFiles;
         d->actualContentList->startSearch(d->queries);
     });
@@ -129,15 +174,171 @@ void ContentList::fileFound(const QString &filePath, const QVariantMap &metaData
     entry.filePath = fileUrl;
     entry.metadata = metaData;
 
-    int newRow = d->entries.count();
-    beginInsertRows({}, newRow, newRow);
-    d->entries.append(entry);
+    d->pendingEntries.append(entry);
     d->knownFiles.insert(filePath);
-    endInsertRows();
 
     if (d->cacheResults) {
         Private::cachedFiles.append(filePath);
     }
+
+    if (d->pendingEntries.count() >= Private::maxPendingEntries) {
+        flushPendingEntries();
+    } else if (!d->pendingEntriesTimer.isActive()) {
+        d->pendingEntriesTimer.start();
+    }
+}
+
+void ContentList::filesFound(const QList<QPair<QString, QVariantMap>> &files)
+{
+    for (const auto &file : files) {
+        fileFound(file.first, file.second);
+    }
+}
+
+void ContentList::flushPendingEntries()
+{
+    d->pendingEntriesTimer.stop();
+    if (d->pendingEntries.isEmpty())
+        return;
+
+    const int firstRow = d->entries.count();
+    beginInsertRows({}, firstRow, firstRow + d->pendingEntries.count() - 1);
+    d->entries.append(d->pendingEntries);
+    d->pendingEntries.clear();
+    endInsertRows();
+}
+
+void ContentList::listerSearchCompleted()
+{
+    // Make sure everything found is in the model before telling anyone the search is done
+    flushPendingEntries();
+    d->searching = false;
+    Q_EMIT searchCompleted();
+    updateWatcher();
+}
+
+void ContentList::fileRemoved(const QString &filePath)
+{
+    if (!d->knownFiles.remove(filePath))
+        return;
+
+    const auto fileUrl = QUrl::fromLocalFile(filePath);
+    for (int row = 0; row < d->pendingEntries.count(); ++row) {
+        if (d->pendingEntries.at(row).filePath == fileUrl) {
+            d->pendingEntries.removeAt(row);
+            if (d->cacheResults) {
+                Private::cachedFiles.removeOne(filePath);
+            }
+            return;
+        }
+    }
+    for (int row = 0; row < d->entries.count(); ++row) {
+        if (d->entries.at(row).filePath == fileUrl) {
+            beginRemoveRows({}, row, row);
+            d->entries.removeAt(row);
+            endRemoveRows();
+            break;
+        }
+    }
+
+    if (d->cacheResults) {
+        Private::cachedFiles.removeOne(filePath);
+    }
+}
+
+void ContentList::watchedFileAdded(const QString &filePath)
+{
+    if (d->knownFiles.contains(filePath))
+        return;
+
+    // Only pick up files the queries would have found, had they been there when searching
+    QMimeDatabase mimeDb;
+    for (const ContentQuery *query : std::as_const(d->queries)) {
+        QStringList locations = query->locations();
+        if (locations.isEmpty())
+            locations.append(QDir::homePath());
+        const bool inLocation = std::any_of(locations.constBegin(), locations.constEnd(), [&filePath](const QString &location) {
+            return filePath.startsWith(QDir::cleanPath(location) + QLatin1Char('/'));
+        });
+        if (!inLocation)
+            continue;
+        if (query->mimeTypes().isEmpty() || query->mimeTypes().contains(ContentListerBase::mimeTypeForFile(mimeDb, filePath))) {
+            fileFound(filePath, ContentListerBase::metaDataForFile(filePath));
+            return;
+        }
+    }
+}
+
+void ContentList::watchedDirectoryRemoved(const QString &path)
+{
+    const QString prefix = path + QLatin1Char('/');
+    QStringList removed;
+    for (const QString &file : std::as_const(d->knownFiles)) {
+        if (file.startsWith(prefix))
+            removed << file;
+    }
+    for (const QString &file : std::as_const(removed)) {
+        fileRemoved(file);
+    }
+}
+
+void ContentList::updateWatcher()
+{
+    if (!d->watchLocations)
+        return;
+
+    if (!d->watcher) {
+        d->watcher = new FilesystemWatcher(this);
+        connect(d->watcher, &FilesystemWatcher::fileAdded, this, &ContentList::watchedFileAdded);
+        connect(d->watcher, &FilesystemWatcher::fileRemoved, this, &ContentList::fileRemoved);
+        connect(d->watcher, &FilesystemWatcher::directoryRemoved, this, &ContentList::watchedDirectoryRemoved);
+        // A directory moved in from elsewhere arrives complete, so nothing inside it gets reported
+        connect(d->watcher, &FilesystemWatcher::directoryAdded, &d->rescanTimer, qOverload<>(&QTimer::start));
+        connect(d->watcher, &FilesystemWatcher::rescanNeeded, &d->rescanTimer, qOverload<>(&QTimer::start));
+        connect(d->watcher, &FilesystemWatcher::watchLimitReached, &d->fallbackRescanTimer, qOverload<>(&QTimer::start));
+    }
+
+    QList<FilesystemWatcher::Root> roots;
+    for (const ContentQuery *query : std::as_const(d->queries)) {
+        QStringList locations = query->locations();
+        if (locations.isEmpty())
+            locations.append(QDir::homePath());
+        const QStringList excluded = query->excludedFolderNames();
+        for (const QString &location : std::as_const(locations)) {
+            roots << FilesystemWatcher::Root{location, query->includeHidden(), QSet<QString>(excluded.constBegin(), excluded.constEnd())};
+        }
+    }
+    d->watcher->setRoots(roots);
+    if (d->watcher->isComplete()) {
+        d->fallbackRescanTimer.stop();
+    }
+}
+
+void ContentList::setLister(ContentListerBase *lister)
+{
+    ContentListerBase *previous = d->actualContentList;
+    d->actualContentList = lister;
+    connect(lister, &ContentListerBase::fileFound, this, &ContentList::fileFound);
+    connect(lister, &ContentListerBase::filesFound, this, &ContentList::filesFound);
+    connect(lister, &ContentListerBase::fileRemoved, this, &ContentList::fileRemoved);
+    connect(lister, &ContentListerBase::searchCompleted, this, &ContentList::listerSearchCompleted);
+
+    if (previous) {
+        // Nothing more is wanted from the old lister, and deleting it stops anything it is still doing
+        disconnect(previous, nullptr, this, nullptr);
+        previous->deleteLater();
+        // What the old lister found is known by now, so running its search again only adds the rest
+        if (d->searching) {
+            rescan();
+        }
+    }
+}
+
+void ContentList::rescan()
+{
+    d->searching = true;
+    d->actualContentList->knownFiles = d->knownFiles;
+    d->actualContentList->startSearch(d->queries);
 }
 
 void ContentList::setAutoSearch(bool autoSearch)
@@ -163,15 +364,34 @@ void ContentList::setCacheResults(bool cacheResults)
     Q_EMIT cacheResultsChanged();
 }
 
+void ContentList::setWatchLocations(bool watchLocations)
+{
+    if (watchLocations == d->watchLocations)
+        return;
+
+    d->watchLocations = watchLocations;
+    if (!d->watchLocations) {
+        delete d->watcher;
+        d->watcher = nullptr;
+        d->rescanTimer.stop();
+        d->fallbackRescanTimer.stop();
+    }
+
+    Q_EMIT watchLocationsChanged();
+}
+
 void ContentList::setKnownFiles(const QStringList &results)
 {
+    // Anything found but not yet added is added first, so it is not lost in the reset
+    flushPendingEntries();
     beginResetModel();
     d->entries.clear();
     d->knownFiles.clear();
     for (const auto &result : results) {
         const auto url = QUrl::fromLocalFile(result);
 
-        const ContentEntry entry{url.fileName(), url, ContentListerBase::metaDataForFile(result)};
+        // The metadata is only looked up if asked for, as this is usually the entire library
+        const ContentEntry entry{url.fileName(), url, {}};
 
         d->entries.append(entry);
         d->knownFiles.insert(result);
@@ -194,13 +414,16 @@ QVariant ContentList::data(const QModelIndex &index, int role) const
         return {};
     }
 
-    const ContentEntry &entry = d->entries[index.row()];
+    ContentEntry &entry = d->entries[index.row()];
     switch (role) {
     case FilenameRole:
         return entry.filename;
     case FilePathRole:
         return entry.filePath;
     case MetadataRole:
+        if (entry.metadata.isEmpty()) {
+            entry.metadata = ContentListerBase::metaDataForFile(entry.filePath.toLocalFile());
+        }
         return entry.metadata;
     }
     return {};
@@ -224,8 +447,10 @@ void ContentList::componentComplete()
     if (d->cacheResults && !Private::cachedFiles.isEmpty())
         setKnownFiles(Private::cachedFiles);
 
-    if (d->autoSearch)
+    if (d->autoSearch) {
+        d->searching = true;
         d->actualContentList->startSearch(d->queries);
+    }
 }
 
 bool ContentList::isComplete() const
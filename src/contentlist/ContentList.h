@@ -36,6 +36,14 @@ class ContentList : public QAbstractListModel, public QQmlParserStatus
      * \brief Whether to cache the search results for later.
      */
     Q_PROPERTY(bool cacheResults READ cacheResults WRITE setCacheResults NOTIFY cacheResultsChanged)
+    /**
+     * \brief Whether to keep watching the search locations for changes once a search completes.
+     *
+     * Files added to or removed from the locations will then show up in the model straight away.
+     * If the locations hold more directories than can be watched, they are instead searched again
+     * every so often, which with the filesystem lister only looks through the directories which changed.
+     */
+    Q_PROPERTY(bool watchLocations READ watchLocations WRITE setWatchLocations NOTIFY watchLocationsChanged)
 public:
     explicit ContentList(QObject *parent = nullptr);
     ~ContentList() override;
@@ -64,6 +72,11 @@ public:
      */
     bool cacheResults() const;
 
+    /**
+     * @return whether to watch the search locations for changes.
+     */
+    bool watchLocations() const;
+
     /**
      * \brief QStrings with names for the extra roles.
      */
@@ -107,6 +120,11 @@ public:
      * @param cacheResults whether to cache the results.
      */
     Q_SLOT void setCacheResults(bool cacheResults);
+    /**
+     * \brief Set whether to watch the search locations for changes.
+     * @param watchLocations whether to watch the search locations.
+     */
+    Q_SLOT void setWatchLocations(bool watchLocations);
 
     /**
      * \brief Fill the model with the results.
@@ -129,6 +147,7 @@ public:
 
     Q_SIGNAL void autoSearchChanged();
     Q_SIGNAL void cacheResultsChanged();
+    Q_SIGNAL void watchLocationsChanged();
     /**
      * \brief Fires when the search is completed.
      */
@@ -139,6 +158,15 @@ public:
 private:
     bool isComplete() const;
     Q_SLOT void fileFound(const QString &filePath, const QVariantMap &metaData);
+    Q_SLOT void filesFound(const QList<QPair<QString, QVariantMap>> &files);
+    void flushPendingEntries();
+    void listerSearchCompleted();
+    Q_SLOT void fileRemoved(const QString &filePath);
+    void watchedFileAdded(const QString &filePath);
+    void watchedDirectoryRemoved(const QString &path);
+    void updateWatcher();
+    void rescan();
+    void setLister(ContentListerBase *lister);
 
     class Private;
     std::unique_ptr<Private> d;
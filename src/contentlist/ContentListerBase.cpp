@@ -5,10 +5,9 @@
 
 #include <QDateTime>
 #include <QFileInfo>
+#include <QMimeDatabase>
 #include <QVariantMap>
 
-#include <KFileMetaData/UserMetaData>
-
 ContentListerBase::ContentListerBase(QObject *parent)
     : QObject(parent)
 {
@@ -31,27 +30,22 @@ QVariantMap ContentListerBase::metaDataForFile(const QString &file)
     // File searchers. Unfortunately, currently KFileMetaData does not seem able
     // to provide this. So this needs changes at a lower level.
 
+    // Only what a single stat gives us. The user's own metadata (rating, tags, reading
+    // progress and so on) lives in extended attributes, each of which can be a round trip
+    // of its own on network filesystems, and so is left for whoever needs it to load.
     QFileInfo info(file);
     metadata["lastModified"] = info.lastModified();
     metadata["created"] = info.birthTime();
     metadata["lastRead"] = info.lastRead();
 
-    KFileMetaData::UserMetaData data(file);
-    if (data.hasAttribute("peruse.currentPage")) {
-        int currentPage = data.attribute("peruse.currentPage").toInt();
-        metadata["currentPage"] = QVariant::fromValue<int>(currentPage);
-    }
-    if (data.hasAttribute("peruse.totalPages")) {
-        int totalPages = data.attribute("peruse.totalPages").toInt();
-        metadata["totalPages"] = QVariant::fromValue<int>(totalPages);
-    }
-    if (!data.tags().isEmpty()) {
-        metadata["tags"] = QVariant::fromValue<QStringList>(data.tags());
-    }
-    if (!data.userComment().isEmpty()) {
-        metadata["comment"] = QVariant::fromValue<QString>(data.userComment());
-    }
-    metadata["rating"] = QVariant::fromValue<int>(data.rating());
-
     return metadata;
 }
+
+QString ContentListerBase::mimeTypeForFile(const QMimeDatabase &mimeDb, const QString &filePath)
+{
+    const QList<QMimeType> candidates = mimeDb.mimeTypesForFileName(filePath.mid(filePath.lastIndexOf(QLatin1Char('/')) + 1));
+    if (candidates.count() == 1) {
+        return candidates.first().name();
+    }
+    return mimeDb.mimeTypeForFile(filePath).name();
+}
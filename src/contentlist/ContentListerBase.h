@@ -5,10 +5,13 @@
 #define CONTENTLISTERBASE_H
 
 #include <QObject>
+#include <QPair>
 #include <QSet>
 #include <QString>
+#include <QVariantMap>
 
 class ContentQuery;
+class QMimeDatabase;
 /**
  * \brief Class to handle the search.
  *
@@ -34,16 +37,49 @@ public:
      * \brief Fires when a matching file is found.
      */
     Q_SIGNAL void fileFound(const QString &filePath, const QVariantMap &metadata);
+    /**
+     * \brief Fires when a number of matching files are found together.
+     *
+     * Listers which find files in bunches (such as all the files in one directory)
+     * should prefer this to firing fileFound() for each of them.
+     *
+     * @param files A list of pairs of file paths and their metadata
+     */
+    Q_SIGNAL void filesFound(const QList<QPair<QString, QVariantMap>> &files);
+    /**
+     * \brief Fires when a file found by an earlier search is no longer there.
+     *
+     * Not all listers are able to tell this, in which case this is never fired.
+     */
+    Q_SIGNAL void fileRemoved(const QString &filePath);
     /**
      * \brief Fires when the search was completed.
      */
     Q_SIGNAL void searchCompleted();
 
     /**
+     * This only holds what can be found without opening the file, that is its
+     * modification, creation and access times. In particular it does not include
+     * anything stored in the file's extended attributes.
+     *
      * @return the available metadata for the filepath so that it can be searched.
      */
     static QVariantMap metaDataForFile(const QString &file);
 
+    /**
+     * \brief Find the mime type of a file, looking at its content only when needed
+     *
+     * The mime type is first looked up by the file's name, and only if that is ambiguous
+     * (or the name does not match anything at all) is the file opened to look at its content.
+     * For libraries, where files nearly always have a correct suffix, this saves opening
+     * almost every file.
+     *
+     * @param mimeDb The mime database to use. QMimeDatabase is cheap to construct, and safe to use from any thread.
+     * @param filePath The path of the file to find the mime type of
+     * @return The name of the most likely mime type for the file
+     */
+    static QString mimeTypeForFile(const QMimeDatabase &mimeDb, const QString &filePath);
+
 protected:
     friend class ContentList;
     QSet<QString> knownFiles;
@@ -6,6 +6,10 @@
 #include <QMimeDatabase>
 #include <QtGui/QImageReader>
 
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
 using namespace Qt::StringLiterals;
 
 class ContentQuery::Private
@@ -17,6 +21,29 @@ public:
     QString searchString;
     QStringList locations;
     QStringList mimeTypes;
+    bool includeHidden = false;
+    QStringList excludedFolderNames{defaultExcludedFolderNames()};
+
+    static QStringList defaultExcludedFolderNames()
+    {
+        QStringList names{u".git"_s,
+                          u".svn"_s,
+                          u".hg"_s,
+                          u"node_modules"_s,
+                          u"__pycache__"_s,
+                          u".cache"_s,
+                          u".Trash"_s,
+                          u"@eaDir"_s,
+                          u"#recycle"_s,
+                          u"$RECYCLE.BIN"_s,
+                          u"System Volume Information"_s,
+                          u"lost+found"_s};
+#ifdef Q_OS_UNIX
+        // The trash directories on removable drives are named for the user they belong to
+        names << u".Trash-%1"_s.arg(getuid());
+#endif
+        return names;
+    }
 };
 
 ContentQuery::ContentQuery(QObject *parent)
@@ -52,6 +79,16 @@ QStringList ContentQuery::mimeTypes() const
     return d->mimeTypesForType(d->type);
 }
 
+bool ContentQuery::includeHidden() const
+{
+    return d->includeHidden;
+}
+
+QStringList ContentQuery::excludedFolderNames() const
+{
+    return d->excludedFolderNames;
+}
+
 void ContentQuery::setType(ContentQuery::Type type)
 {
     if (type == d->type)
@@ -88,6 +125,24 @@ void ContentQuery::setMimeTypes(const QStringList &mimeTypes)
     emit mimeTypesChanged();
 }
 
+void ContentQuery::setIncludeHidden(bool includeHidden)
+{
+    if (includeHidden == d->includeHidden)
+        return;
+
+    d->includeHidden = includeHidden;
+    emit includeHiddenChanged();
+}
+
+void ContentQuery::setExcludedFolderNames(const QStringList &excludedFolderNames)
+{
+    if (excludedFolderNames == d->excludedFolderNames)
+        return;
+
+    d->excludedFolderNames = excludedFolderNames;
+    emit excludedFolderNamesChanged();
+}
+
 namespace
 {
 QStringList contentQueryVideo()
@@ -36,6 +36,18 @@ class ContentQuery : public QObject
      * is based on the type property.
      */
     Q_PROPERTY(QStringList mimeTypes READ mimeTypes WRITE setMimeTypes NOTIFY mimeTypesChanged)
+    /**
+     * Whether hidden files and directories should be searched. Defaults to false.
+     */
+    Q_PROPERTY(bool includeHidden READ includeHidden WRITE setIncludeHidden NOTIFY includeHiddenChanged)
+    /**
+     * A list of directory names which should not be searched, wherever they are found.
+     *
+     * By default this contains the names of version control, cache and build directories,
+     * and of the metadata directories some network storage devices create, none of which
+     * are likely to contain anything worth finding.
+     */
+    Q_PROPERTY(QStringList excludedFolderNames READ excludedFolderNames WRITE setExcludedFolderNames NOTIFY excludedFolderNamesChanged)
 
 public:
     /**
@@ -79,6 +91,14 @@ public:
      * Get the mimeTypes property.
      */
     QStringList mimeTypes() const;
+    /**
+     * Get the includeHidden property.
+     */
+    bool includeHidden() const;
+    /**
+     * Get the excludedFolderNames property.
+     */
+    QStringList excludedFolderNames() const;
 
 public Q_SLOTS:
     /**
@@ -105,6 +125,18 @@ public Q_SLOTS:
      * \param mimeTypes The new list of mime types.
      */
     void setMimeTypes(const QStringList &mimeTypes);
+    /**
+     * Set the includeHidden property.
+     *
+     * \param includeHidden Whether to search hidden files and directories.
+     */
+    void setIncludeHidden(bool includeHidden);
+    /**
+     * Set the excludedFolderNames property.
+     *
+     * \param excludedFolderNames The new list of directory names to skip.
+     */
+    void setExcludedFolderNames(const QStringList &excludedFolderNames);
 
 Q_SIGNALS:
     /**
@@ -123,6 +155,14 @@ Q_SIGNALS:
      * Emitted whenever the mimeTypes property changes.
      */
     void mimeTypesChanged();
+    /**
+     * Emitted whenever the includeHidden property changes.
+     */
+    void includeHiddenChanged();
+    /**
+     * Emitted whenever the excludedFolderNames property changes.
+     */
+    void excludedFolderNamesChanged();
 
 private:
     class Private;
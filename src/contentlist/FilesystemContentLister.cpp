@@ -3,114 +3,506 @@
 
 #include "FilesystemContentLister.h"
 
-#include <KFileMetaData/UserMetaData>
-
-#include <QCoreApplication>
+#include <QDataStream>
 #include <QDateTime>
+#include <QDir>
 #include <QDirIterator>
+#include <QFile>
 #include <QMimeDatabase>
-#include <QRunnable>
+#include <QMutex>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThread>
 #include <QThreadPool>
-#include <QTimer>
-#include <QVariantHash>
+#include <QVariantMap>
+#include <QWaitCondition>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
 
 #include "ContentQuery.h"
 
-class FileSystemSearcher : public QObject, public QRunnable
+using namespace Qt::StringLiterals;
+
+namespace
+{
+/**
+ * What a directory looked like the last time it was listed. The names of the subdirectories
+ * and matching files are kept, rather than just how many there are, so that when a directory
+ * is unchanged the walk can carry on into its subdirectories without listing it again, and
+ * when it has changed, the files which have disappeared from it can be reported.
+ */
+struct DirectoryState {
+    qint64 lastModified{0};
+    QStringList subdirectories;
+    QStringList files;
+};
+
+QDataStream &operator<<(QDataStream &stream, const DirectoryState &state)
+{
+    return stream << state.lastModified << state.subdirectories << state.files;
+}
+
+QDataStream &operator>>(QDataStream &stream, DirectoryState &state)
+{
+    return stream >> state.lastModified >> state.subdirectories >> state.files;
+}
+
+// Directory states, by the directory's path
+typedef QHash<QString, DirectoryState> DirectorySnapshot;
+
+// Bump this whenever the layout of the snapshot file changes
+static const quint32 snapshotVersion = 1;
+
+// Files are reported once per directory, or in batches of this many for large directories
+static const int maxBatchSize = 500;
+
+/**
+ * The parts of a ContentQuery the walk needs, copied out on the gui thread,
+ * so the workers never need to touch the query object itself.
+ */
+struct QueryRules {
+    QSet<QString> mimeTypes;
+    QSet<QString> excludedFolderNames;
+    bool includeHidden{false};
+    // Which files a directory holds depends on the rules used to find them, so
+    // snapshots are kept separately for each set of rules
+    QString snapshotKey;
+    // The snapshot from the previous walk, if there was one
+    const DirectorySnapshot *previous{nullptr};
+    // The locations the walk starts from
+    QStringList roots;
+};
+
+struct WorkItem {
+    QString path;
+    int query{0};
+    bool root{false};
+};
+
+struct WorkQueue {
+    QMutex mutex;
+    std::deque<WorkItem> items;
+};
+}
+
+class FilesystemContentLister::Private
 {
-    Q_OBJECT
 public:
-    FileSystemSearcher(ContentQuery *query)
-        : QObject()
+    Private(FilesystemContentLister *qq)
+        : q(qq)
     {
-        m_query = query;
+        pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
     }
+    FilesystemContentLister *q;
+    QThreadPool pool;
+
+    // Searches requested while another was still running
+    QList<QList<ContentQuery *>> pendingSearches;
+    bool searching{false};
+
+    QList<QueryRules> rules;
+    QSet<QString> knownFiles;
+
+    QString snapshotFile{QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + QStringLiteral("/directories.snapshot")};
+    bool snapshotLoaded{false};
+    // The state of the directories as of the last completed walk, which the current walk compares against
+    QHash<QString, DirectorySnapshot> snapshot;
+    // The state of the directories as seen by the current walk
+    QMutex currentSnapshotMutex;
+    QHash<QString, DirectorySnapshot> currentSnapshot;
 
-    void run() override
+    // One queue per worker. The owner pushes and pops at the back, so it works depth first
+    // and stays within the part of the tree it has already been reading, and others steal
+    // from the front, which is where the largest untouched subtrees are.
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    // The number of directories queued up or being listed. When this reaches zero, the walk is done.
+    std::atomic<int> outstanding{0};
+    std::atomic<int> runningWorkers{0};
+    std::atomic<bool> aborted{false};
+    QMutex idleMutex;
+    QWaitCondition workAvailable;
+
+    void push(int worker, const WorkItem &item)
     {
-        QMimeDatabase mimeDb;
+        ++outstanding;
+        {
+            QMutexLocker locker(&queues[worker]->mutex);
+            queues[worker]->items.push_back(item);
+        }
+        QMutexLocker locker(&idleMutex);
+        workAvailable.wakeOne();
+    }
 
-        auto locations = m_query->locations();
-        if (locations.isEmpty())
-            locations.append(QDir::homePath());
+    bool take(int worker, WorkItem *item)
+    {
+        {
+            WorkQueue *own = queues[worker].get();
+            QMutexLocker locker(&own->mutex);
+            if (!own->items.empty()) {
+                *item = std::move(own->items.back());
+                own->items.pop_back();
+                return true;
+            }
+        }
+        for (std::size_t i = 1; i < queues.size(); ++i) {
+            WorkQueue *other = queues[(worker + i) % queues.size()].get();
+            QMutexLocker locker(&other->mutex);
+            if (!other->items.empty()) {
+                *item = std::move(other->items.front());
+                other->items.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
 
-        for (const auto &location : locations) {
-            QDirIterator it(location, QDirIterator::Subdirectories);
-            while (it.hasNext()) {
-                auto filePath = it.next();
+    void finishItem()
+    {
+        if (--outstanding == 0) {
+            QMutexLocker locker(&idleMutex);
+            workAvailable.wakeAll();
+        }
+    }
 
-                if (it.fileInfo().isDir())
-                    continue;
+    void record(const QueryRules &rule, const QString &path, const DirectoryState &state)
+    {
+        QMutexLocker locker(&currentSnapshotMutex);
+        currentSnapshot[rule.snapshotKey].insert(path, state);
+    }
 
-                if (!m_query->mimeTypes().isEmpty()) {
-                    QString mimeType = mimeDb.mimeTypeForFile(filePath).name();
-                    if (!m_query->mimeTypes().contains(mimeType))
-                        continue;
+    /**
+     * Report every file in a directory which has since disappeared, along with everything
+     * found in the subdirectories below it.
+     */
+    void removeSubtree(const QueryRules &rule, const QString &path)
+    {
+        const auto it = rule.previous->constFind(path);
+        if (it == rule.previous->constEnd()) {
+            return;
+        }
+        for (const QString &file : it->files) {
+            Q_EMIT q->fileRemoved(path + QLatin1Char('/') + file);
+        }
+        for (const QString &subdirectory : it->subdirectories) {
+            removeSubtree(rule, path + QLatin1Char('/') + subdirectory);
+        }
+    }
+
+    /**
+     * Keep the previous state of a directory, and everything below it, as it was
+     */
+    void keepSubtree(const QueryRules &rule, const QString &path)
+    {
+        const auto it = rule.previous->constFind(path);
+        if (it == rule.previous->constEnd()) {
+            return;
+        }
+        record(rule, path, *it);
+        for (const QString &subdirectory : it->subdirectories) {
+            keepSubtree(rule, path + QLatin1Char('/') + subdirectory);
+        }
+    }
+
+    void listDirectory(int worker, const WorkItem &item, const QMimeDatabase &mimeDb)
+    {
+        const QueryRules &rule = rules.at(item.query);
+        const DirectoryState *previous = nullptr;
+        if (rule.previous) {
+            const auto it = rule.previous->constFind(item.path);
+            if (it != rule.previous->constEnd()) {
+                previous = &(*it);
+            }
+        }
+
+        const QFileInfo directoryInfo(item.path);
+        if (!directoryInfo.isDir()) {
+            // A location which has gone away entirely is more likely to be an unmounted drive
+            // than a deleted library, so keep what we knew about it for when it comes back.
+            if (item.root && rule.previous) {
+                keepSubtree(rule, item.path);
+            }
+            return;
+        }
+
+        // Adding, removing or renaming anything in a directory changes its modification time,
+        // so if that is the same as last time, there is no need to list the directory again
+        const qint64 lastModified = directoryInfo.lastModified().toMSecsSinceEpoch();
+        if (previous && previous->lastModified == lastModified) {
+            record(rule, item.path, *previous);
+            QList<QPair<QString, QVariantMap>> found;
+            for (const QString &file : previous->files) {
+                const QString filePath = item.path + QLatin1Char('/') + file;
+                if (!knownFiles.contains(filePath)) {
+                    found << qMakePair(filePath, ContentListerBase::metaDataForFile(filePath));
                 }
+            }
+            if (!found.isEmpty()) {
+                Q_EMIT q->filesFound(found);
+            }
+            for (const QString &subdirectory : previous->subdirectories) {
+                push(worker, {item.path + QLatin1Char('/') + subdirectory, item.query});
+            }
+            return;
+        }
 
-                auto metadata = ContentListerBase::metaDataForFile(filePath);
+        QSet<QString> previousFiles;
+        if (previous) {
+            previousFiles = QSet<QString>(previous->files.constBegin(), previous->files.constEnd());
+        }
+
+        QList<QPair<QString, QVariantMap>> found;
+        DirectoryState state;
+        state.lastModified = lastModified;
+        QDir::Filters filters = QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot;
+        if (rule.includeHidden) {
+            filters |= QDir::Hidden;
+        }
+        QDirIterator it(item.path, filters);
+        while (it.hasNext() && !aborted) {
+            const QString filePath = it.next();
+            const QFileInfo info = it.fileInfo();
 
-                emit fileFound(filePath, metadata);
+            if (info.isDir()) {
+                // Following links to directories risks both loops and listing the same tree twice
+                if (!info.isSymLink() && !rule.excludedFolderNames.contains(info.fileName())) {
+                    state.subdirectories << info.fileName();
+                    push(worker, {filePath, item.query});
+                }
+                continue;
             }
+
+            if (knownFiles.contains(filePath) || previousFiles.contains(info.fileName())) {
+                // Already matched once, so no need to work out its type again
+                state.files << info.fileName();
+                if (!knownFiles.contains(filePath)) {
+                    found << qMakePair(filePath, ContentListerBase::metaDataForFile(filePath));
+                }
+                continue;
+            }
+
+            if (!rule.mimeTypes.isEmpty() && !rule.mimeTypes.contains(ContentListerBase::mimeTypeForFile(mimeDb, filePath))) {
+                continue;
+            }
+
+            state.files << info.fileName();
+            found << qMakePair(filePath, ContentListerBase::metaDataForFile(filePath));
+            if (found.count() >= maxBatchSize) {
+                Q_EMIT q->filesFound(found);
+                found.clear();
+            }
+        }
+        if (!found.isEmpty()) {
+            Q_EMIT q->filesFound(found);
+        }
+        if (aborted) {
+            return;
         }
 
-        emit finished(this);
+        if (previous) {
+            const QSet<QString> files(state.files.constBegin(), state.files.constEnd());
+            for (const QString &file : previous->files) {
+                if (!files.contains(file)) {
+                    Q_EMIT q->fileRemoved(item.path + QLatin1Char('/') + file);
+                }
+            }
+            const QSet<QString> subdirectories(state.subdirectories.constBegin(), state.subdirectories.constEnd());
+            for (const QString &subdirectory : previous->subdirectories) {
+                if (!subdirectories.contains(subdirectory)) {
+                    removeSubtree(rule, item.path + QLatin1Char('/') + subdirectory);
+                }
+            }
+        }
+        record(rule, item.path, state);
     }
 
-Q_SIGNALS:
-    void fileFound(const QString &path, const QVariantMap &metaData);
-    void finished(FileSystemSearcher *searcher);
+    void loadSnapshot()
+    {
+        snapshotLoaded = true;
+        QFile file(snapshotFile);
+        if (!file.open(QIODevice::ReadOnly)) {
+            return;
+        }
+        QDataStream stream(&file);
+        quint32 version{0};
+        stream >> version;
+        if (version != snapshotVersion) {
+            return;
+        }
+        stream >> snapshot;
+        if (stream.status() != QDataStream::Ok) {
+            snapshot.clear();
+        }
+    }
 
-private:
-    ContentQuery *m_query;
-};
+    /**
+     * Called from the last worker to finish, once the walk has completed
+     */
+    void saveSnapshot()
+    {
+        // Only what is under the locations this walk went through is replaced. Other locations,
+        // and the snapshots for other sets of rules, are kept for the walks which go through them.
+        for (const QueryRules &rule : std::as_const(rules)) {
+            const auto existing = snapshot.find(rule.snapshotKey);
+            if (existing == snapshot.end()) {
+                continue;
+            }
+            for (auto it = existing->begin(); it != existing->end();) {
+                const bool walked = std::any_of(rule.roots.constBegin(), rule.roots.constEnd(), [&it](const QString &root) {
+                    return it.key() == root || it.key().startsWith(root.endsWith(QLatin1Char('/')) ? root : root + QLatin1Char('/'));
+                });
+                if (walked) {
+                    it = existing->erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        for (auto it = currentSnapshot.constBegin(); it != currentSnapshot.constEnd(); ++it) {
+            snapshot[it.key()].insert(it.value());
+        }
+        currentSnapshot.clear();
+        QDir().mkpath(QFileInfo(snapshotFile).absolutePath());
+        QSaveFile file(snapshotFile);
+        if (!file.open(QIODevice::WriteOnly)) {
+            return;
+        }
+        QDataStream stream(&file);
+        stream << snapshotVersion << snapshot;
+        file.commit();
+    }
 
-class FilesystemContentLister::Private
-{
-public:
-    Private()
+    void work(int worker)
+    {
+        QMimeDatabase mimeDb;
+        while (!aborted) {
+            WorkItem item;
+            if (take(worker, &item)) {
+                listDirectory(worker, item, mimeDb);
+                finishItem();
+                continue;
+            }
+            QMutexLocker locker(&idleMutex);
+            if (outstanding == 0 || aborted) {
+                break;
+            }
+            // Someone else is still listing, and may yet find more directories for us.
+            // The timeout covers pushes which happen between our failed take and this wait.
+            workAvailable.wait(&idleMutex, 20);
+        }
+        if (--runningWorkers == 0) {
+            if (!aborted) {
+                saveSnapshot();
+            }
+            QMetaObject::invokeMethod(
+                q,
+                [this]() {
+                    walkFinished();
+                },
+                Qt::QueuedConnection);
+        }
+    }
+
+    void startWalk(const QList<ContentQuery *> &queries)
     {
+        searching = true;
+        aborted = false;
+        rules.clear();
+        queues.clear();
+        knownFiles = q->knownFiles;
+        if (!snapshotLoaded) {
+            loadSnapshot();
+        }
+        currentSnapshot.clear();
+
+        const int workerCount = pool.maxThreadCount();
+        for (int i = 0; i < workerCount; ++i) {
+            queues.push_back(std::make_unique<WorkQueue>());
+        }
+
+        int seeded = 0;
+        for (ContentQuery *query : queries) {
+            QueryRules rule;
+            const QStringList mimeTypes = query->mimeTypes();
+            rule.mimeTypes = QSet<QString>(mimeTypes.constBegin(), mimeTypes.constEnd());
+            const QStringList excluded = query->excludedFolderNames();
+            rule.excludedFolderNames = QSet<QString>(excluded.constBegin(), excluded.constEnd());
+            rule.includeHidden = query->includeHidden();
+            QStringList keyParts = mimeTypes;
+            keyParts.sort();
+            QStringList sortedExcluded = excluded;
+            sortedExcluded.sort();
+            keyParts << u"|"_s << sortedExcluded << (rule.includeHidden ? u"hidden"_s : u"nohidden"_s);
+            rule.snapshotKey = keyParts.join(QLatin1Char(';'));
+            const auto previous = snapshot.constFind(rule.snapshotKey);
+            if (previous != snapshot.constEnd()) {
+                rule.previous = &(*previous);
+            }
+            rules << rule;
+
+            QStringList locations = query->locations();
+            if (locations.isEmpty())
+                locations.append(QDir::homePath());
+            for (const QString &location : std::as_const(locations)) {
+                const QString root = QDir::cleanPath(location);
+                rules.last().roots << root;
+                push(seeded % workerCount, {root, int(rules.count() - 1), true});
+                ++seeded;
+            }
+        }
+
+        if (seeded == 0) {
+            walkFinished();
+            return;
+        }
+
+        runningWorkers = workerCount;
+        for (int i = 0; i < workerCount; ++i) {
+            pool.start([this, i]() {
+                work(i);
+            });
+        }
     }
 
-    QList<FileSystemSearcher *> runnables;
+    void walkFinished()
+    {
+        searching = false;
+        if (aborted) {
+            return;
+        }
+        if (!pendingSearches.isEmpty()) {
+            startWalk(pendingSearches.takeFirst());
+        } else {
+            Q_EMIT q->searchCompleted();
+        }
+    }
 };
 
 FilesystemContentLister::FilesystemContentLister(QObject *parent)
     : ContentListerBase(parent)
-    , d(new Private)
+    , d(new Private(this))
 {
 }
 
 FilesystemContentLister::~FilesystemContentLister()
 {
-    QThreadPool::globalInstance()->waitForDone();
+    d->aborted = true;
+    {
+        QMutexLocker locker(&d->idleMutex);
+        d->workAvailable.wakeAll();
+    }
+    d->pool.waitForDone();
     delete d;
 }
 
 void FilesystemContentLister::startSearch(const QList<ContentQuery *> &queries)
 {
-    for (const auto &query : queries) {
-        auto runnable = new FileSystemSearcher{query};
-        connect(runnable, &FileSystemSearcher::fileFound, this, &FilesystemContentLister::fileFound);
-        connect(runnable, &FileSystemSearcher::finished, this, &FilesystemContentLister::queryFinished);
-
-        d->runnables.append(runnable);
-    }
-
-    if (!d->runnables.isEmpty())
-        QThreadPool::globalInstance()->start(d->runnables.first());
-}
-
-void FilesystemContentLister::queryFinished(QRunnable *runnable)
-{
-    d->runnables.removeAll(static_cast<FileSystemSearcher *>(runnable));
-
-    if (!d->runnables.isEmpty()) {
-        QThreadPool::globalInstance()->start(d->runnables.first());
-    } else {
-        emit searchCompleted();
+    if (d->searching) {
+        d->pendingSearches << queries;
+        return;
     }
+    d->startWalk(queries);
 }
-
-// This needs to be included since we define a QObject subclass here in the C++ file.
-#include "FilesystemContentLister.moc"
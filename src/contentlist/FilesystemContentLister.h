@@ -4,10 +4,18 @@
 #ifndef FILESYSTEMCONTENTLISTER_H
 #define FILESYSTEMCONTENTLISTER_H
 
-#include <QRunnable>
-
 #include "ContentListerBase.h"
 
+/**
+ * \brief A content lister which walks the filesystem directly
+ *
+ * The directory trees of all the queries are walked at the same time, by a set of worker
+ * threads which each list one directory at a time. Workers push the subdirectories they
+ * find onto their own queue, and when that runs dry they take work from the other workers,
+ * so a single deep tree is spread out across all the workers just as well as many small ones.
+ *
+ * Files are reported through filesFound() as they are found, a directory at a time, from the worker threads.
+ */
 class FilesystemContentLister : public ContentListerBase
 {
     Q_OBJECT
@@ -16,13 +24,14 @@ public:
     ~FilesystemContentLister() override;
     /**
      * \brief Start a search.
+     *
+     * If a search is already running, the new search will be started once that one completes.
+     *
      * @param queries  List of ContentQueries that the search should be limited to.
      */
     void startSearch(const QList<ContentQuery *> &queries) override;
 
 private:
-    void queryFinished(QRunnable *runnable);
-
     class Private;
     Private *d;
 };
@@ -0,0 +1,291 @@
+// SPDX-FileCopyrightText: 2026 Peruse contributors
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "FilesystemWatcher.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QSocketNotifier>
+#include <QThreadPool>
+
+#include <atomic>
+
+#ifdef Q_OS_LINUX
+#include <cerrno>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+class FilesystemWatcher::Private
+{
+public:
+    Private(FilesystemWatcher *qq)
+        : q(qq)
+    {
+        // Adding watches is mostly waiting on the disk, so one thread is plenty, and
+        // keeps the order the trees are added in predictable
+        pool.setMaxThreadCount(1);
+#ifdef Q_OS_LINUX
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd >= 0) {
+            notifier = new QSocketNotifier(fd, QSocketNotifier::Read, q);
+            QObject::connect(notifier, &QSocketNotifier::activated, q, [this]() {
+                readEvents();
+            });
+        }
+        // The watches are shared between everything the user runs, so leave most of them for others
+        int systemLimit{8192};
+        QFile limitFile(QStringLiteral("/proc/sys/fs/inotify/max_user_watches"));
+        if (limitFile.open(QIODevice::ReadOnly)) {
+            bool ok{false};
+            const int limit = limitFile.readAll().trimmed().toInt(&ok);
+            if (ok && limit > 0) {
+                systemLimit = limit;
+            }
+        }
+        budget = systemLimit / 4;
+#endif
+    }
+    FilesystemWatcher *q;
+    QList<Root> roots;
+    QThreadPool pool;
+    // Incremented whenever the roots change, so trees still being added for the old roots stop
+    std::atomic<int> generation{0};
+    std::atomic<bool> complete{true};
+    int budget{0};
+
+#ifdef Q_OS_LINUX
+    int fd{-1};
+    QSocketNotifier *notifier{nullptr};
+
+    QMutex mutex;
+    // Watch descriptor to the watched directory, and the index of the root it is in
+    QHash<int, QPair<QString, int>> watches;
+    QHash<QString, int> watchesByPath;
+
+    static constexpr uint32_t watchMask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+
+    bool addWatch(const QString &path, int rootIndex)
+    {
+        QMutexLocker locker(&mutex);
+        if (watchesByPath.contains(path)) {
+            return true;
+        }
+        if (watches.count() >= budget) {
+            return false;
+        }
+        const int wd = inotify_add_watch(fd, QFile::encodeName(path).constData(), watchMask);
+        if (wd < 0) {
+            // Running out of watches is the only failure which means the rest will fail too,
+            // anything else (such as a directory we can't read) just means skipping this one
+            return errno != ENOSPC;
+        }
+        watches.insert(wd, qMakePair(path, rootIndex));
+        watchesByPath.insert(path, wd);
+        return true;
+    }
+
+    void removeTree(const QString &path)
+    {
+        const QString prefix = path + QLatin1Char('/');
+        QMutexLocker locker(&mutex);
+        QHash<QString, int>::iterator it = watchesByPath.begin();
+        while (it != watchesByPath.end()) {
+            if (it.key() == path || it.key().startsWith(prefix)) {
+                inotify_rm_watch(fd, it.value());
+                watches.remove(it.value());
+                it = watchesByPath.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void readEvents()
+    {
+        alignas(struct inotify_event) char buffer[16384];
+        const ssize_t length = read(fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            return;
+        }
+        const struct inotify_event *event = nullptr;
+        for (const char *ptr = buffer; ptr < buffer + length; ptr += sizeof(struct inotify_event) + event->len) {
+            event = reinterpret_cast<const struct inotify_event *>(ptr);
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                Q_EMIT q->rescanNeeded();
+                continue;
+            }
+
+            QString directory;
+            int rootIndex{-1};
+            {
+                QMutexLocker locker(&mutex);
+                const auto it = watches.constFind(event->wd);
+                if (it == watches.constEnd()) {
+                    continue;
+                }
+                directory = it->first;
+                rootIndex = it->second;
+                if (event->mask & IN_IGNORED) {
+                    // The directory is gone, and the kernel has removed the watch for us
+                    watchesByPath.remove(directory);
+                    watches.remove(event->wd);
+                    continue;
+                }
+            }
+            if (event->len == 0 || rootIndex < 0 || rootIndex >= roots.count()) {
+                continue;
+            }
+
+            const Root &root = roots.at(rootIndex);
+            const QString name = QFile::decodeName(event->name);
+            if (!root.includeHidden && name.startsWith(QLatin1Char('.'))) {
+                continue;
+            }
+            const QString path = directory + QLatin1Char('/') + name;
+
+            if (event->mask & IN_ISDIR) {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    if (!root.excludedFolderNames.contains(name)) {
+                        startAddingTree(path, rootIndex);
+                        Q_EMIT q->directoryAdded(path);
+                    }
+                } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    // A directory moved elsewhere keeps its watches, which would then report
+                    // changes under the old path, so those need to go as well
+                    removeTree(path);
+                    Q_EMIT q->directoryRemoved(path);
+                }
+            } else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                Q_EMIT q->fileAdded(path);
+            } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                Q_EMIT q->fileRemoved(path);
+            }
+        }
+    }
+#endif
+
+    void reportLimitReached(int treeGeneration)
+    {
+        if (complete.exchange(false)) {
+            QMetaObject::invokeMethod(
+                q,
+                [this, treeGeneration]() {
+                    if (treeGeneration == generation) {
+                        Q_EMIT q->watchLimitReached();
+                    }
+                },
+                Qt::QueuedConnection);
+        }
+    }
+
+    void addTree(const QString &path, const Root &root, int rootIndex, int treeGeneration)
+    {
+#ifdef Q_OS_LINUX
+        QDir::Filters filters = QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks;
+        if (root.includeHidden) {
+            filters |= QDir::Hidden;
+        }
+        QStringList pending{path};
+        while (!pending.isEmpty()) {
+            if (treeGeneration != generation) {
+                return;
+            }
+            const QString directory = pending.takeLast();
+            if (!addWatch(directory, rootIndex)) {
+                reportLimitReached(treeGeneration);
+                return;
+            }
+            QDirIterator it(directory, filters);
+            while (it.hasNext()) {
+                const QString subdirectory = it.next();
+                if (!root.excludedFolderNames.contains(it.fileName())) {
+                    pending << subdirectory;
+                }
+            }
+        }
+#else
+        Q_UNUSED(path)
+        Q_UNUSED(root)
+        Q_UNUSED(rootIndex)
+        reportLimitReached(treeGeneration);
+#endif
+    }
+
+    void startAddingTree(const QString &path, int rootIndex)
+    {
+        const int treeGeneration = generation;
+        const Root root = roots.at(rootIndex);
+        pool.start([this, path, root, rootIndex, treeGeneration]() {
+            addTree(path, root, rootIndex, treeGeneration);
+        });
+    }
+};
+
+FilesystemWatcher::FilesystemWatcher(QObject *parent)
+    : QObject(parent)
+    , d(new Private(this))
+{
+}
+
+FilesystemWatcher::~FilesystemWatcher()
+{
+    clear();
+#ifdef Q_OS_LINUX
+    if (d->fd >= 0) {
+        close(d->fd);
+    }
+#endif
+    delete d;
+}
+
+void FilesystemWatcher::setRoots(const QList<Root> &roots)
+{
+    if (roots == d->roots) {
+        return;
+    }
+    clear();
+    d->roots = roots;
+    d->complete = true;
+#ifdef Q_OS_LINUX
+    if (d->fd < 0) {
+        if (!roots.isEmpty()) {
+            d->reportLimitReached(d->generation);
+        }
+        return;
+    }
+#endif
+    for (int i = 0; i < roots.count(); ++i) {
+        d->startAddingTree(QDir::cleanPath(roots.at(i).path), i);
+    }
+}
+
+void FilesystemWatcher::clear()
+{
+    ++d->generation;
+    d->pool.clear();
+    d->pool.waitForDone();
+    d->roots.clear();
+#ifdef Q_OS_LINUX
+    QMutexLocker locker(&d->mutex);
+    for (auto it = d->watches.constBegin(); it != d->watches.constEnd(); ++it) {
+        inotify_rm_watch(d->fd, it.key());
+    }
+    d->watches.clear();
+    d->watchesByPath.clear();
+#endif
+}
+
+int FilesystemWatcher::watchBudget() const
+{
+    return d->budget;
+}
+
+bool FilesystemWatcher::isComplete() const
+{
+    return d->complete;
+}
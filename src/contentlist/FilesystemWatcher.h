@@ -0,0 +1,102 @@
+// SPDX-FileCopyrightText: 2026 Peruse contributors
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#ifndef FILESYSTEMWATCHER_H
+#define FILESYSTEMWATCHER_H
+
+#include <QObject>
+#include <QSet>
+#include <QString>
+
+/**
+ * \brief Watches directory trees for files being added, removed and moved
+ *
+ * On Linux this uses inotify, with one watch for every directory in the trees. Each user
+ * has a limited number of watches available to them, shared between all applications,
+ * so the watcher only ever uses part of that (see watchBudget()). If the trees need more
+ * watches than that, watchLimitReached() is emitted, and what is watched should be treated
+ * as incomplete. The same happens straight away on systems where watching is not supported.
+ *
+ * Changes to files are only reported once the file has been closed after writing, or was
+ * moved into place, so a book which is still being downloaded is not picked up half-done.
+ */
+class FilesystemWatcher : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FilesystemWatcher(QObject *parent = nullptr);
+    ~FilesystemWatcher() override;
+
+    /**
+     * A directory tree to be watched, and the rules for which subdirectories to leave out
+     */
+    struct Root {
+        QString path;
+        bool includeHidden{false};
+        QSet<QString> excludedFolderNames;
+        bool operator==(const Root &other) const
+        {
+            return path == other.path && includeHidden == other.includeHidden && excludedFolderNames == other.excludedFolderNames;
+        }
+    };
+
+    /**
+     * \brief Set the directory trees to watch
+     *
+     * Watches are added in the background, so changes made in the first moments after setting
+     * the roots may be missed. Setting the same roots again does nothing.
+     *
+     * @param roots The trees to watch
+     */
+    void setRoots(const QList<Root> &roots);
+    /**
+     * \brief Stop watching everything
+     */
+    void clear();
+
+    /**
+     * @return The largest number of directories the watcher will watch at once
+     */
+    int watchBudget() const;
+    /**
+     * @return Whether all the directories in the trees are being watched
+     */
+    bool isComplete() const;
+
+    /**
+     * \brief Fired when a file was written, or moved into a watched directory
+     */
+    Q_SIGNAL void fileAdded(const QString &filePath);
+    /**
+     * \brief Fired when a file was deleted, or moved out of a watched directory
+     */
+    Q_SIGNAL void fileRemoved(const QString &filePath);
+    /**
+     * \brief Fired when a directory was created, or moved into a watched directory
+     *
+     * Anything in a moved directory is not reported individually, so listeners should
+     * look through it themselves.
+     */
+    Q_SIGNAL void directoryAdded(const QString &path);
+    /**
+     * \brief Fired when a directory was deleted, or moved out of a watched directory
+     */
+    Q_SIGNAL void directoryRemoved(const QString &path);
+    /**
+     * \brief Fired when events were lost, and the trees should be checked for changes
+     */
+    Q_SIGNAL void rescanNeeded();
+    /**
+     * \brief Fired when not all of the trees could be watched
+     *
+     * Changes in the directories which are not watched will not be reported, so the trees
+     * should be checked for changes every so often instead.
+     */
+    Q_SIGNAL void watchLimitReached();
+
+private:
+    class Private;
+    Private *d;
+};
+
+#endif // FILESYSTEMWATCHER_H
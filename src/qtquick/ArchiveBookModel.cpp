@@ -21,6 +21,8 @@
 
 #include "ArchiveBookModel.h"
 #include "ArchiveImageProvider.h"
+#include "ArchivePageCache.h"
+#include "BookMetadataIngester.h"
 
 #include <AcbfAuthor.h>
 #include <AcbfBody.h>
@@ -39,6 +41,8 @@
 #include <QMimeDatabase>
 #include <QQmlEngine>
 #include <QTemporaryFile>
+#include <QThread>
+#include <QWaitCondition>
 #include <QXmlStreamReader>
 
 #include "KRar.h" // "" because it's a custom thing for now
@@ -61,6 +65,8 @@ public:
         , imageProvider(nullptr)
         , isDirty(false)
         , isLoading(false)
+        , metadataOnly(false)
+        , pageCache(nullptr)
     {
     }
     ~Private()
@@ -68,6 +74,9 @@ public:
         for (int fontId : fontIdByFilename.values()) {
             fontDatabase.removeApplicationFont(fontId);
         }
+        // Ensure there is no read-ahead left working on the archive before getting rid of it
+        delete pageCache;
+        setReaderSource(QString(), false);
         delete archive;
     }
     ArchiveBookModel *q;
@@ -79,14 +88,114 @@ public:
     ArchiveImageProvider *imageProvider;
     bool isDirty;
     bool isLoading;
+    bool metadataOnly;
     QMimeDatabase mimeDatabase;
     QFontDatabase fontDatabase;
     QHash<QString, int> fontIdByFilename;
     QString acbfEntryName;
+    ArchivePageCache *pageCache;
+
+    /**
+     * Read-only archive handles used to read entry data, so that several entries can be
+     * inflated at the same time. Each has its own file descriptor and directory index,
+     * and is only ever used by one thread at a time.
+     */
+    QMutex readerMutex;
+    QWaitCondition readerAvailable;
+    QList<KArchive *> idleReaders;
+    int readerCount{0};
+    int readersInUse{0};
+    QString readerFileName;
+    bool readersAreRar{false};
+    // Each reader on a solid rar archive decompresses the whole archive into a spool of its own,
+    // so there is no point in having more than one of them. Nothing else spools, so this is the
+    // only time a solid archive gets decompressed in full.
+    int maxReaders{1};
+
+    KArchive *checkoutReader()
+    {
+        QMutexLocker locker(&readerMutex);
+        while (idleReaders.isEmpty()) {
+            if (readerFileName.isEmpty()) {
+                return nullptr;
+            }
+            if (readerCount < maxReaders) {
+                // Opening parses the archive's directory, so do that without holding up everybody else
+                const QString fileName = readerFileName;
+                const bool isRar = readersAreRar;
+                ++readerCount;
+                ++readersInUse;
+                locker.unlock();
+                KArchive *reader{nullptr};
+                if (isRar) {
+                    // The readers go on to read page after page, so for them (and only them) a solid
+                    // archive is worth decompressing once into a spool
+                    KRar *rar = new KRar(fileName);
+                    rar->setSpooling(true);
+                    reader = rar;
+                } else {
+                    reader = new KZip(fileName);
+                }
+                if (!reader->open(QIODevice::ReadOnly)) {
+                    qCDebug(QTQUICK_LOG) << "Failed to open a reader for the archive" << fileName;
+                    delete reader;
+                    reader = nullptr;
+                    locker.relock();
+                    --readerCount;
+                    --readersInUse;
+                    readerAvailable.wakeAll();
+                }
+                return reader;
+            }
+            readerAvailable.wait(&readerMutex);
+        }
+        ++readersInUse;
+        return idleReaders.takeLast();
+    }
+
+    void returnReader(KArchive *reader)
+    {
+        QMutexLocker locker(&readerMutex);
+        --readersInUse;
+        if (readerFileName.isEmpty()) {
+            // The book was closed while this reader was out, so nobody wants it any longer
+            delete reader;
+            --readerCount;
+        } else {
+            idleReaders << reader;
+        }
+        readerAvailable.wakeAll();
+    }
+
+    /**
+     * Waits for all readers to be returned and closes them, and sets the archive new readers will be opened on.
+     * Pass an empty filename to stop handing out readers altogether.
+     */
+    void setReaderSource(const QString &fileName, bool isRar, bool isSolid = false)
+    {
+        QMutexLocker locker(&readerMutex);
+        readerFileName.clear();
+        while (readersInUse > 0) {
+            readerAvailable.wait(&readerMutex);
+        }
+        qDeleteAll(idleReaders);
+        idleReaders.clear();
+        readerCount = 0;
+        readerFileName = fileName;
+        readersAreRar = isRar;
+        maxReaders = isSolid ? 1 : qMax(1, QThread::idealThreadCount());
+        readerAvailable.wakeAll();
+    }
 
     void closeBook()
     {
-        q->beginResetModel();
+        if (pageCache) {
+            pageCache->clear();
+        }
+        setReaderSource(QString(), false);
+        if (!metadataOnly) {
+            q->beginResetModel();
+        }
         if (archive) {
             q->clearPages();
             archiveFiles.clear();
@@ -103,10 +212,34 @@ public:
         Q_EMIT q->fileEntriesChanged();
         fileEntriesToDelete.clear();
         Q_EMIT q->fileEntriesToDeleteChanged();
-        q->endResetModel();
+        if (!metadataOnly) {
+            q->endResetModel();
+        }
         acbfEntryName.clear();
     }
 
+    /**
+     * The archive entry names of all pages, in reading order (that is, the page urls without the image provider prefix)
+     */
+    QStringList pageIds() const
+    {
+        QStringList ids;
+        if (imageProvider) {
+            const int prefixLength = QString("image://%1/").arg(imageProvider->prefix()).length();
+            for (int i = 0; i < q->pageCount(); ++i) {
+                ids << q->data(q->index(i, 0, QModelIndex()), BookModel::UrlRole).toString().mid(prefixLength);
+            }
+        }
+        return ids;
+    }
+
+    void readAroundCurrentPage()
+    {
+        if (imageProvider && !isLoading) {
+            pageCache->readAround(pageIds(), q->currentPage());
+        }
+    }
+
     static int counter()
     {
         static int count = 0;
@@ -190,6 +323,9 @@ ArchiveBookModel::ArchiveBookModel(QObject *parent)
     : BookModel(parent)
     , d(new Private(this))
 {
+    connect(this, &BookModel::currentPageChanged, this, [this]() {
+        d->readAroundCurrentPage();
+    });
 }
 
 ArchiveBookModel::~ArchiveBookModel()
@@ -220,7 +356,9 @@ void ArchiveBookModel::setFilename(QString newFilename)
     setProcessing(true);
     d->isLoading = true;
     d->closeBook();
-    beginResetModel();
+    if (!d->metadataOnly) {
+        beginResetModel();
+    }
 
     QMimeType mime = d->mimeDatabase.mimeTypeForFile(newFilename);
     if (mime.inherits("application/zip")) {
@@ -234,11 +372,20 @@ void ArchiveBookModel::setFilename(QString newFilename)
         QString prefix = QString("archivebookpage%1").arg(QString::number(Private::counter()));
         if (d->archive->open(QIODevice::ReadOnly)) {
             QMutexLocker locker(&archiveMutex);
-            d->imageProvider = new ArchiveImageProvider();
-            d->imageProvider->setArchiveBookModel(this);
-            d->imageProvider->setPrefix(prefix);
-            auto engine = qmlEngine(this);
-            engine->addImageProvider(prefix, d->imageProvider);
+            if (!d->metadataOnly) {
+                // Only books which are going to be read need somewhere to keep their pages, and
+                // a pool to read ahead on, so metadata-only models never create one
+                if (!d->pageCache) {
+                    d->pageCache = new ArchivePageCache(this);
+                }
+                KRar *rar = dynamic_cast<KRar *>(d->archive);
+                d->setReaderSource(newFilename, rar != nullptr, rar && rar->isSolid());
+                d->imageProvider = new ArchiveImageProvider();
+                d->imageProvider->setArchiveBookModel(this);
+                d->imageProvider->setPrefix(prefix);
+                auto engine = qmlEngine(this);
+                engine->addImageProvider(prefix, d->imageProvider);
+            }
 
             d->fileEntries = recursiveEntries(d->archive->directory());
             d->fileEntries.sort();
@@ -332,9 +479,13 @@ void ArchiveBookModel::setFilename(QString newFilename)
     //     }
     BookModel::setFilename(newFilename);
 
-    KFileMetaData::UserMetaData data(newFilename);
-    if (data.hasAttribute("peruse.currentPage"))
-        BookModel::setCurrentPage(data.attribute("peruse.currentPage").toInt(), false);
+    // Metadata-only models are used while ingesting, which reads the reading progress along with
+    // the rest of the extended attributes once (see BookMetadataIngester::userMetadataForFile)
+    if (!d->metadataOnly) {
+        KFileMetaData::UserMetaData data(newFilename);
+        if (data.hasAttribute("peruse.currentPage"))
+            BookModel::setCurrentPage(data.attribute("peruse.currentPage").toInt(), false);
+    }
 
     if (!acbfData() && d->readWrite && d->imageProvider) {
         d->createNewAcbfDocumentFromLegacyInformation();
@@ -343,7 +494,19 @@ void ArchiveBookModel::setFilename(QString newFilename)
     d->isLoading = false;
     emit loadingCompleted(success);
     setProcessing(false);
-    endResetModel();
+    if (!d->metadataOnly) {
+        endResetModel();
+    }
+}
+
+bool ArchiveBookModel::metadataOnly() const
+{
+    return d->metadataOnly;
+}
+
+void ArchiveBookModel::setMetadataOnly(bool metadataOnly)
+{
+    d->metadataOnly = metadataOnly;
 }
 
 QString ArchiveBookModel::author() const
@@ -681,6 +844,8 @@ void ArchiveBookModel::addPageFromFile(QString fileUrl, int insertAfter)
         d->archive->addLocalFile(fileUrl, archiveFileName);
         d->archive->close();
         d->archive->open(QIODevice::ReadOnly);
+        // Any open readers will have the old directory, so make sure new ones are opened
+        d->setReaderSource(d->archive->fileName(), false);
         addPage(QString("image://%1/%2").arg(d->imageProvider->prefix()).arg(archiveFileName), archiveFileName.split("/").last());
         d->fileEntries << archiveFileName;
         d->fileEntries.sort();
@@ -753,6 +918,34 @@ bool ArchiveBookModel::createBook(const QUrl &fileName, const QString &title, co
     return success;
 }
 
+ArchivePageCache *ArchiveBookModel::pageCache() const
+{
+    return d->pageCache;
+}
+
+void ArchiveBookModel::pageRequested(const QString &id, const QSize &requestedSize)
+{
+    if (!d->pageCache || !requestedSize.isValid() || d->pageIds().value(currentPage()) != id) {
+        return;
+    }
+    d->pageCache->setReadAheadSize(requestedSize);
+    d->readAroundCurrentPage();
+}
+
+QByteArray ArchiveBookModel::archiveFileData(const QString &filePath) const
+{
+    QByteArray data;
+    KArchive *reader = d->checkoutReader();
+    if (reader) {
+        const KArchiveFile *file = reader->directory()->file(filePath);
+        if (file) {
+            data = file->data();
+        }
+        d->returnReader(reader);
+    }
+    return data;
+}
+
 const KArchiveFile *ArchiveBookModel::archiveFile(const QString &filePath) const
 {
     if (d->archive->isOpen() == false) {
@@ -808,6 +1001,7 @@ bool ArchiveBookModel::loadComicInfoXML(QString xmlDocument, QObject *acbfData,
                 else if (xmlReader.name() == QStringLiteral("Notes")) {
                     if (filedata.userComment().isEmpty()) {
                         filedata.setUserComment(xmlReader.readElementText());
+                        BookMetadataIngester::forgetUserMetadata(filename);
                     } else {
                         xmlReader.skipCurrentElement();
                     }
@@ -820,12 +1014,15 @@ bool ArchiveBookModel::loadComicInfoXML(QString xmlDocument, QObject *acbfData,
                         }
                     }
                     filedata.setTags(tags);
+                    BookMetadataIngester::forgetUserMetadata(filename);
                 } else if (xmlReader.name() == QStringLiteral("PageCount")) {
                     filedata.setAttribute("Peruse.totalPages", xmlReader.readElementText());
+                    BookMetadataIngester::forgetUserMetadata(filename);
                 } else if (xmlReader.name() == QStringLiteral("ScanInformation")) {
                     QString userComment = filedata.userComment();
                     userComment.append("\n" + xmlReader.readElementText());
                     filedata.setUserComment(userComment);
+                    BookMetadataIngester::forgetUserMetadata(filename);
                 }
 
                 // Series
@@ -1090,11 +1287,13 @@ bool ArchiveBookModel::loadCoMet(QStringList xmlDocuments, QObject *acbfData, QS
                     // pages
                     else if (xmlReader.name() == QStringLiteral("pages")) {
                         filedata.setAttribute("Peruse.totalPages", xmlReader.readElementText());
+                        BookMetadataIngester::forgetUserMetadata(filename);
                     }
                     // curentpage -- only read this when there's no such entry.
                     else if (xmlReader.name() == QStringLiteral("lastMark")) {
                         if (!filedata.hasAttribute("Peruse.currentPage")) {
                             filedata.setAttribute("Peruse.currentPage", xmlReader.readElementText());
+                            BookMetadataIngester::forgetUserMetadata(filename);
                         } else {
                             xmlReader.skipCurrentElement();
                         }
@@ -24,6 +24,7 @@
 
 #include "BookModel.h"
 #include <QMutex>
+#include <QSize>
 #include <QUrl>
 #include <qqmlregistration.h>
 
@@ -37,6 +38,7 @@
  * setting the current page, and returning basic metadata.
  */
 class KArchiveFile;
+class ArchivePageCache;
 class ArchiveBookModel : public BookModel
 {
     Q_OBJECT
@@ -55,6 +57,21 @@ public:
      */
     void setFilename(QString newFilename) override;
 
+    /**
+     * Whether the model only loads the book's metadata. In this mode no image provider
+     * is registered for the pages, and the model is not reset when loading, which means
+     * the model can be used outside of the gui thread (for example when ingesting books
+     * into the library). This must be set before setting the filename.
+     * @return True if the model only loads the book's metadata
+     */
+    bool metadataOnly() const;
+    /**
+     * \brief Set whether the model should only load the book's metadata
+     * @see metadataOnly()
+     * @param metadataOnly True to only load metadata
+     */
+    void setMetadataOnly(bool metadataOnly);
+
     /**
      * The author name will be either the default bookmodel author name, or
      * if ACBF data is available, the first authorname in the list of ACBF authors.
@@ -255,12 +272,48 @@ public:
     Q_INVOKABLE QString firstAvailableFont(const QStringList &fontList);
 
     friend class ArchiveImageRunnable;
+    friend class ArchiveImageProvider;
 
     void setAcbfData(QObject *obj) override;
 
 protected:
+    /**
+     * The file entry with the given path in the book's archive. This shares the archive's
+     * directory index with the model, so archiveMutex must be held while using the entry.
+     * To simply read the contents of an entry, use archiveFileData() instead.
+     */
     const KArchiveFile *archiveFile(const QString &filePath) const;
+    /**
+     * Guards the archive held by the model, and its directory index
+     */
     QMutex archiveMutex;
+    /**
+     * \brief Read the contents of a file in the book's archive
+     *
+     * This reads through one of a set of read-only handles on the archive, and does not
+     * require holding archiveMutex, so several entries can be read at the same time.
+     * If all handles are in use, this will block until one becomes available.
+     *
+     * @param filePath The path of the file inside the archive
+     * @return The contents of the file, or an empty array if it could not be read
+     */
+    QByteArray archiveFileData(const QString &filePath) const;
+
+    /**
+     * @return The cache holding the decoded pages of this book, or null if no book has been
+     * opened for reading yet (which is never the case for metadata-only models)
+     */
+    ArchivePageCache *pageCache() const;
+    /**
+     * \brief Called by the image provider whenever a page is requested
+     *
+     * When the requested page is the current page, the size it is requested at is used
+     * to read ahead the pages surrounding it.
+     *
+     * @param id The archive entry name of the requested page
+     * @param requestedSize The size the page was requested at
+     */
+    void pageRequested(const QString &id, const QSize &requestedSize);
 
 private:
     class Private;
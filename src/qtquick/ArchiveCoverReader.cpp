@@ -0,0 +1,409 @@
+// SPDX-FileCopyrightText: 2026 Peruse contributors
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "ArchiveCoverReader.h"
+
+#include <KCompressionDevice>
+#include <KRar.h>
+#include <KZip>
+#include <karchive.h>
+#include <karchivefile.h>
+
+#include <QBuffer>
+#include <QFile>
+#include <QHash>
+#include <QMap>
+#include <QMimeDatabase>
+#include <QXmlStreamReader>
+
+#include <qtquick_debug.h>
+
+namespace
+{
+// Metadata documents larger than this probably embed their images, and aren't worth inflating just for a hint
+static const quint32 maxHintDocumentSize = 1024 * 1024;
+// Deflate cannot expand data by more than this factor, so an entry claiming to be any larger
+// than that is corrupt (or crafted to have us allocate a great deal of memory)
+static const qint64 maxDeflateRatio = 1032;
+// No cover image is ever anywhere near this large
+static const qint64 maxEntrySize = 256 * 1024 * 1024;
+// How much of an entry is inflated at a time
+static const qint64 inflateChunkSize = 64 * 1024;
+
+struct ZipEntry {
+    quint16 flags{0};
+    quint16 method{0};
+    quint32 compressedSize{0};
+    quint32 uncompressedSize{0};
+    quint32 localHeaderOffset{0};
+};
+
+quint16 readU16(const QByteArray &data, int pos)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(data.constData()) + pos;
+    return quint16(p[0]) | (quint16(p[1]) << 8);
+}
+
+quint32 readU32(const QByteArray &data, int pos)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(data.constData()) + pos;
+    return quint32(p[0]) | (quint32(p[1]) << 8) | (quint32(p[2]) << 16) | (quint32(p[3]) << 24);
+}
+
+bool isImage(const QString &entry)
+{
+    return entry.endsWith(QLatin1String(".gif"), Qt::CaseInsensitive) || entry.endsWith(QLatin1String(".jpg"), Qt::CaseInsensitive)
+        || entry.endsWith(QLatin1String(".jpeg"), Qt::CaseInsensitive) || entry.endsWith(QLatin1String(".png"), Qt::CaseInsensitive);
+}
+}
+
+class ArchiveCoverReader::Private
+{
+public:
+    Private(const QString &fileName)
+        : file(fileName)
+    {
+    }
+    ~Private()
+    {
+        delete archive;
+    }
+    QFile file;
+    QStringList entries;
+    QString coverEntry;
+    bool coverEntryFound{false};
+
+    // Set when the archive was read through the central directory
+    bool isZip{false};
+    QHash<QString, ZipEntry> zipEntries;
+
+    // Used for everything else
+    KArchive *archive{nullptr};
+    QHash<QString, quint32> archiveEntrySizes;
+
+    bool readCentralDirectory()
+    {
+        const qint64 size = file.size();
+        if (size < 22) {
+            return false;
+        }
+        // The end of central directory record is at the very end, followed only by the archive comment
+        const qint64 tailSize = qMin<qint64>(size, 22 + 65535);
+        if (!file.seek(size - tailSize)) {
+            return false;
+        }
+        const QByteArray tail = file.read(tailSize);
+        int endRecord = -1;
+        for (int i = tail.size() - 22; i >= 0; --i) {
+            if (readU32(tail, i) == 0x06054b50) {
+                endRecord = i;
+                break;
+            }
+        }
+        if (endRecord < 0) {
+            return false;
+        }
+        const quint16 entryCount = readU16(tail, endRecord + 10);
+        const quint32 directorySize = readU32(tail, endRecord + 12);
+        const quint32 directoryOffset = readU32(tail, endRecord + 16);
+        if (entryCount == 0xffff || directoryOffset == 0xffffffff || directorySize == 0xffffffff) {
+            // Zip64, which KZip knows how to deal with
+            return false;
+        }
+        if (qint64(directoryOffset) + directorySize > size || !file.seek(directoryOffset)) {
+            return false;
+        }
+        const QByteArray directory = file.read(directorySize);
+        if (directory.size() != int(directorySize)) {
+            return false;
+        }
+
+        int pos = 0;
+        // Every record counts towards the total in the end record, including those for directories
+        // and any names which turn up more than once, neither of which end up in zipEntries
+        int recordCount = 0;
+        while (pos + 46 <= directory.size() && readU32(directory, pos) == 0x02014b50) {
+            ZipEntry entry;
+            entry.flags = readU16(directory, pos + 8);
+            entry.method = readU16(directory, pos + 10);
+            entry.compressedSize = readU32(directory, pos + 20);
+            entry.uncompressedSize = readU32(directory, pos + 24);
+            const quint16 nameLength = readU16(directory, pos + 28);
+            const quint16 extraLength = readU16(directory, pos + 30);
+            const quint16 commentLength = readU16(directory, pos + 32);
+            entry.localHeaderOffset = readU32(directory, pos + 42);
+            if (pos + 46 + nameLength > directory.size()) {
+                return false;
+            }
+            const QByteArray rawName = directory.mid(pos + 46, nameLength);
+            // Bit 11 marks names stored as UTF-8, otherwise we do as KZip does
+            const QString name = (entry.flags & 0x0800) ? QString::fromUtf8(rawName) : QFile::decodeName(rawName);
+            if (!name.endsWith(QLatin1Char('/'))) {
+                if (!zipEntries.contains(name)) {
+                    entries << name;
+                }
+                zipEntries.insert(name, entry);
+            }
+            pos += 46 + nameLength + extraLength + commentLength;
+            ++recordCount;
+        }
+        return recordCount == entryCount;
+    }
+
+    QByteArray readZipEntry(const ZipEntry &entry)
+    {
+        if (entry.flags & 0x0001) {
+            // Encrypted, and we've no password to give it
+            return QByteArray();
+        }
+        if (!file.seek(entry.localHeaderOffset)) {
+            return QByteArray();
+        }
+        const QByteArray header = file.read(30);
+        if (header.size() != 30 || readU32(header, 0) != 0x04034b50) {
+            return QByteArray();
+        }
+        // The local header's name and extra field lengths can differ from those in the central directory
+        const qint64 dataOffset = qint64(entry.localHeaderOffset) + 30 + readU16(header, 26) + readU16(header, 28);
+        if (!file.seek(dataOffset)) {
+            return QByteArray();
+        }
+        if (qint64(entry.compressedSize) > qMin(maxEntrySize, file.size() - dataOffset)) {
+            qCDebug(QTQUICK_LOG) << "Skipping an entry which claims to be larger than the archive in" << file.fileName();
+            return QByteArray();
+        }
+        QByteArray compressed = file.read(entry.compressedSize);
+        if (compressed.size() != int(entry.compressedSize)) {
+            return QByteArray();
+        }
+        if (entry.method == 0) {
+            return compressed;
+        }
+        if (entry.method != 8) {
+            qCDebug(QTQUICK_LOG) << "Unsupported compression method" << entry.method << "in" << file.fileName();
+            return QByteArray();
+        }
+        QBuffer buffer(&compressed);
+        KCompressionDevice device(&buffer, false, KCompressionDevice::GZip);
+        // Zip entries are raw deflate streams, without the gzip headers
+        device.setSkipHeaders();
+        if (!device.open(QIODevice::ReadOnly)) {
+            return QByteArray();
+        }
+        const qint64 expectedSize = entry.uncompressedSize;
+        if (expectedSize > qMin(maxEntrySize, qMax<qint64>(compressed.size(), 1) * maxDeflateRatio)) {
+            qCDebug(QTQUICK_LOG) << "Skipping an entry with an impossible uncompressed size" << expectedSize << "in" << file.fileName();
+            return QByteArray();
+        }
+        // Read in chunks rather than allocating whatever size the directory claims up front
+        QByteArray data;
+        while (data.size() < expectedSize) {
+            const QByteArray chunk = device.read(qMin(inflateChunkSize, expectedSize - data.size()));
+            if (chunk.isEmpty()) {
+                break;
+            }
+            data.append(chunk);
+        }
+        return data;
+    }
+
+    void listArchive(const QString &prefix, const KArchiveDirectory *dir)
+    {
+        for (const QString &entry : dir->entries()) {
+            const KArchiveEntry *e = dir->entry(entry);
+            if (e->isDirectory()) {
+                listArchive(prefix + entry + QLatin1Char('/'), static_cast<const KArchiveDirectory *>(e));
+            } else if (e->isFile()) {
+                entries << prefix + entry;
+                archiveEntrySizes.insert(prefix + entry, quint32(static_cast<const KArchiveFile *>(e)->size()));
+            }
+        }
+    }
+
+    bool openArchive()
+    {
+        QMimeDatabase db;
+        const QMimeType mime = db.mimeTypeForFile(file.fileName(), QMimeDatabase::MatchContent);
+        if (mime.inherits("application/x-cbr") || mime.inherits("application/x-rar")) {
+            archive = new KRar(file.fileName());
+        } else if (mime.inherits("application/x-cbz") || mime.inherits("application/zip")) {
+            archive = new KZip(file.fileName());
+        } else {
+            return false;
+        }
+        if (!archive->open(QIODevice::ReadOnly) || !archive->directory()) {
+            return false;
+        }
+        listArchive(QString(), archive->directory());
+        return true;
+    }
+
+    quint32 entrySize(const QString &entry) const
+    {
+        if (isZip) {
+            return zipEntries.value(entry).uncompressedSize;
+        }
+        return archiveEntrySizes.value(entry);
+    }
+
+    QString findEntry(const QString &name, const QString &suffix = QString()) const
+    {
+        for (const QString &entry : entries) {
+            if ((!name.isEmpty() && entry.compare(name, Qt::CaseInsensitive) == 0)
+                || (!suffix.isEmpty() && entry.endsWith(suffix, Qt::CaseInsensitive))) {
+                return entry;
+            }
+        }
+        return QString();
+    }
+
+    /**
+     * The image the ACBF document names as its cover page, if it is a file in the archive
+     */
+    QString acbfCover(const QByteArray &document) const
+    {
+        QXmlStreamReader xml(document);
+        bool inCoverPage = false;
+        while (!xml.atEnd()) {
+            xml.readNext();
+            if (xml.isStartElement()) {
+                if (xml.name() == QLatin1String("coverpage")) {
+                    inCoverPage = true;
+                } else if (inCoverPage && xml.name() == QLatin1String("image")) {
+                    for (const QXmlStreamAttribute &attribute : xml.attributes()) {
+                        if (attribute.name() == QLatin1String("href")) {
+                            const QString href = attribute.value().toString();
+                            // References starting with # are to images embedded in the document itself
+                            if (!href.startsWith(QLatin1Char('#'))) {
+                                return findEntry(href);
+                            }
+                        }
+                    }
+                    return QString();
+                } else if (xml.name() == QLatin1String("body")) {
+                    // The metadata is done with, so no cover page is coming
+                    return QString();
+                }
+            } else if (xml.isEndElement() && xml.name() == QLatin1String("coverpage")) {
+                return QString();
+            }
+        }
+        return QString();
+    }
+
+    /**
+     * The index of the page ComicInfo.xml marks as the front cover, or -1 if there is none
+     */
+    int comicInfoCover(const QByteArray &document) const
+    {
+        QXmlStreamReader xml(document);
+        while (!xml.atEnd()) {
+            xml.readNext();
+            if (xml.isStartElement() && xml.name() == QLatin1String("Page")
+                && xml.attributes().value(QLatin1String("Type")) == QLatin1String("FrontCover")) {
+                bool ok = false;
+                const int image = xml.attributes().value(QLatin1String("Image")).toInt(&ok);
+                return ok ? image : -1;
+            }
+        }
+        return -1;
+    }
+};
+
+ArchiveCoverReader::ArchiveCoverReader(const QString &fileName)
+    : d(new Private(fileName))
+{
+}
+
+ArchiveCoverReader::~ArchiveCoverReader()
+{
+    delete d;
+}
+
+bool ArchiveCoverReader::open()
+{
+    if (!d->file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    if (d->readCentralDirectory()) {
+        d->isZip = true;
+        return true;
+    }
+    d->entries.clear();
+    d->zipEntries.clear();
+    d->file.close();
+    return d->openArchive();
+}
+
+QStringList ArchiveCoverReader::entries() const
+{
+    return d->entries;
+}
+
+QString ArchiveCoverReader::coverEntry()
+{
+    if (d->coverEntryFound) {
+        return d->coverEntry;
+    }
+    d->coverEntryFound = true;
+
+    /// Sort case-insensitive, then remove non-image entries.
+    QMap<QString, QString> entryMap;
+    for (const QString &entry : std::as_const(d->entries)) {
+        if (isImage(entry)) {
+            entryMap.insert(entry.toLower(), entry);
+        }
+    }
+    const QStringList images = entryMap.values();
+    if (images.isEmpty()) {
+        return QString();
+    }
+
+    const QString acbf = d->findEntry(QString(), QStringLiteral(".acbf"));
+    if (!acbf.isEmpty() && d->entrySize(acbf) <= maxHintDocumentSize) {
+        const QString cover = d->acbfCover(entryData(acbf));
+        if (!cover.isEmpty()) {
+            d->coverEntry = cover;
+            return d->coverEntry;
+        }
+    }
+
+    const QString comicInfo = d->findEntry(QStringLiteral("ComicInfo.xml"));
+    if (!comicInfo.isEmpty() && d->entrySize(comicInfo) <= maxHintDocumentSize) {
+        const int cover = d->comicInfoCover(entryData(comicInfo));
+        if (cover >= 0 && cover < images.count()) {
+            d->coverEntry = images.at(cover);
+            return d->coverEntry;
+        }
+    }
+
+    d->coverEntry = images.first();
+    return d->coverEntry;
+}
+
+QByteArray ArchiveCoverReader::coverData()
+{
+    const QString cover = coverEntry();
+    if (cover.isEmpty()) {
+        return QByteArray();
+    }
+    return entryData(cover);
+}
+
+QByteArray ArchiveCoverReader::entryData(const QString &entry)
+{
+    if (d->isZip) {
+        const auto it = d->zipEntries.constFind(entry);
+        if (it == d->zipEntries.constEnd()) {
+            return QByteArray();
+        }
+        return d->readZipEntry(*it);
+    }
+    if (d->archive && d->archive->directory()) {
+        const KArchiveFile *archiveFile = d->archive->directory()->file(entry);
+        if (archiveFile) {
+            return archiveFile->data();
+        }
+    }
+    return QByteArray();
+}
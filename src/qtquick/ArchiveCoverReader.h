@@ -0,0 +1,63 @@
+// SPDX-FileCopyrightText: 2026 Peruse contributors
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#ifndef ARCHIVECOVERREADER_H
+#define ARCHIVECOVERREADER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+
+/**
+ * \brief Finds and reads the cover image of a comic book archive, touching as little of the archive as possible
+ *
+ * For ZIP based archives (cbz), only the archive's central directory is read to find the entries,
+ * and only the entry holding the cover (plus, if small enough, the book's ACBF or ComicInfo document)
+ * is then inflated. RAR based archives (cbr) are read through KRar, which only walks the archive's
+ * header chain to find the entries. Anything else, or anything too unusual for the fast path (such
+ * as Zip64 archives), is read through KZip.
+ *
+ * The cover is the image pointed to by the ACBF document's coverpage, or failing that the page marked
+ * as the front cover in ComicInfo.xml, and otherwise the first image in the archive by name.
+ */
+class ArchiveCoverReader
+{
+public:
+    explicit ArchiveCoverReader(const QString &fileName);
+    ~ArchiveCoverReader();
+
+    /**
+     * \brief Open the archive and read its list of entries
+     * @return True if the archive could be opened
+     */
+    bool open();
+
+    /**
+     * @return The names of all the files in the archive, relative to its root
+     */
+    QStringList entries() const;
+
+    /**
+     * @return The name of the entry holding the book's cover, or an empty string if there are no images
+     */
+    QString coverEntry();
+
+    /**
+     * \brief Read the data for the book's cover
+     * @return The encoded cover image, or an empty array if none could be read
+     */
+    QByteArray coverData();
+
+    /**
+     * \brief Read a single entry from the archive
+     * @param entry The name of the entry, as found in entries()
+     * @return The contents of the entry, or an empty array if it could not be read
+     */
+    QByteArray entryData(const QString &entry);
+
+private:
+    class Private;
+    Private *d;
+};
+
+#endif // ARCHIVECOVERREADER_H
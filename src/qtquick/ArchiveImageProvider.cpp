@@ -21,9 +21,7 @@
 
 #include "ArchiveImageProvider.h"
 #include "ArchiveBookModel.h"
-
-#include <karchive.h>
-#include <karchivefile.h>
+#include "ArchivePageCache.h"
 
 #include <QBuffer>
 #include <QIcon>
@@ -94,6 +92,16 @@ public:
 QQuickImageResponse *ArchiveImageProvider::requestImageResponse(const QString &id, const QSize &requestedSize)
 {
     ArchiveImageResponse *response = new ArchiveImageResponse(id, requestedSize, d->bookModel, d->prefix);
+    if (d->bookModel) {
+        // Requests arrive on the pixmap reader's thread, but the model lives on the gui thread
+        ArchiveBookModel *bookModel = d->bookModel;
+        QMetaObject::invokeMethod(
+            bookModel,
+            [bookModel, id, requestedSize]() {
+                bookModel->pageRequested(id, requestedSize);
+            },
+            Qt::QueuedConnection);
+    }
     return response;
 }
 
@@ -132,6 +140,25 @@ public:
     ArchiveBookModel *bookModel{nullptr};
     QString prefix;
 
+    /**
+     * The size an image of the given size should be decoded at to fit inside the requested size,
+     * keeping its aspect ratio. A requested width or height of zero or less means that dimension
+     * is unconstrained. Images are only ever scaled down, never up, and an invalid size is returned
+     * if the image should be decoded as it is.
+     */
+    QSize targetSize(const QSize &imageSize) const
+    {
+        if (imageSize.isEmpty()) {
+            return QSize();
+        }
+        QSize bounds(requestedSize.width() > 0 ? requestedSize.width() : imageSize.width(),
+                     requestedSize.height() > 0 ? requestedSize.height() : imageSize.height());
+        if (bounds.width() >= imageSize.width() && bounds.height() >= imageSize.height()) {
+            return QSize();
+        }
+        return imageSize.scaled(bounds, Qt::KeepAspectRatio).expandedTo(QSize(1, 1));
+    }
+
     QString errorString;
     bool loadImage(QImage *image, const QByteArray &data)
     {
@@ -139,9 +166,22 @@ public:
         b.setData(data);
         b.open(QIODevice::ReadOnly);
         QImageReader reader(&b, nullptr);
+
+        // Reading the size only touches the image's header, so this is cheap
+        const QSize scaledSize = targetSize(reader.size());
+        const bool readerScales = scaledSize.isValid() && reader.supportsOption(QImageIOHandler::ScaledSize);
+        if (readerScales) {
+            // The jpeg handler does most of this in the DCT domain while decoding, meaning
+            // the full resolution image is never held in memory
+            reader.setScaledSize(scaledSize);
+        }
+
         bool success = reader.read(image);
         if (success) {
             errorString.clear();
+            if (scaledSize.isValid() && !readerScales && image->size() != scaledSize) {
+                *image = image->scaled(scaledSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+            }
         } else {
             errorString = reader.errorString();
         }
@@ -175,6 +215,12 @@ void ArchiveImageRunnable::run() // const QString& id, QSize* size, const QSize&
     QImage img;
     bool success = false;
 
+    ArchivePageCache *cache = d->bookModel->pageCache();
+    if (cache->find(d->id, d->requestedSize, &img)) {
+        Q_EMIT done(img);
+        return;
+    }
+
     /*
      * In ACBF, image references starting with a '#' refer to files embedded
      * in the <data> section of the .acbf file.
@@ -194,14 +240,17 @@ void ArchiveImageRunnable::run() // const QString& id, QSize* size, const QSize&
     }
 
     if (!d->isAborted() && !success) {
-        QMutexLocker locker(&d->bookModel->archiveMutex);
-        const KArchiveFile *entry = d->bookModel->archiveFile(d->id);
+        const QByteArray data = d->bookModel->archiveFileData(d->id);
 
-        if (!d->isAborted() && entry) {
-            success = d->loadImage(&img, entry->data());
+        if (!d->isAborted() && !data.isEmpty()) {
+            success = d->loadImage(&img, data);
         }
     }
 
+    if (success) {
+        cache->insert(d->id, d->requestedSize, img);
+    }
+
     if (!d->isAborted() && !success) {
         QIcon oops = QIcon::fromTheme("unknown");
         img = oops.pixmap(oops.availableSizes().last()).toImage();
@@ -0,0 +1,139 @@
+// SPDX-FileCopyrightText: 2026 Peruse contributors
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "ArchivePageCache.h"
+#include "ArchiveImageProvider.h"
+
+#include <QCache>
+#include <QMutex>
+#include <QThreadPool>
+
+class ArchivePageCache::Private
+{
+public:
+    Private(ArchiveBookModel *bookModel)
+        : bookModel(bookModel)
+    {
+        // Read-ahead is a background nicety, and should not compete with the
+        // pages actually being requested for the global thread pool's threads
+        readAheadPool.setMaxThreadCount(2);
+    }
+    ArchiveBookModel *bookModel{nullptr};
+
+    mutable QMutex mutex;
+    QCache<QString, QImage> images;
+
+    QThreadPool readAheadPool;
+    int readAhead{3};
+    int readBehind{1};
+    QSize readAheadSize;
+
+    static QString key(const QString &id, const QSize &requestedSize)
+    {
+        return QStringLiteral("%1@%2x%3").arg(id).arg(requestedSize.width()).arg(requestedSize.height());
+    }
+};
+
+ArchivePageCache::ArchivePageCache(ArchiveBookModel *bookModel, qint64 maxBytes)
+    : d(new Private(bookModel))
+{
+    d->images.setMaxCost(maxBytes);
+}
+
+ArchivePageCache::~ArchivePageCache()
+{
+    clear();
+    delete d;
+}
+
+bool ArchivePageCache::find(const QString &id, const QSize &requestedSize, QImage *image) const
+{
+    QMutexLocker locker(&d->mutex);
+    const QImage *cached = d->images.object(Private::key(id, requestedSize));
+    if (cached) {
+        *image = *cached;
+        return true;
+    }
+    return false;
+}
+
+void ArchivePageCache::insert(const QString &id, const QSize &requestedSize, const QImage &image)
+{
+    if (image.isNull()) {
+        return;
+    }
+    QMutexLocker locker(&d->mutex);
+    // QCache takes ownership, and deletes the object straight away if it is too expensive to hold on to
+    d->images.insert(Private::key(id, requestedSize), new QImage(image), image.sizeInBytes());
+}
+
+void ArchivePageCache::clear()
+{
+    d->readAheadPool.clear();
+    d->readAheadPool.waitForDone();
+    QMutexLocker locker(&d->mutex);
+    d->images.clear();
+}
+
+qint64 ArchivePageCache::maxBytes() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->images.maxCost();
+}
+
+void ArchivePageCache::setMaxBytes(qint64 maxBytes)
+{
+    QMutexLocker locker(&d->mutex);
+    d->images.setMaxCost(maxBytes);
+}
+
+void ArchivePageCache::setReadAhead(int ahead, int behind)
+{
+    QMutexLocker locker(&d->mutex);
+    d->readAhead = qMax(0, ahead);
+    d->readBehind = qMax(0, behind);
+}
+
+void ArchivePageCache::setReadAheadSize(const QSize &size)
+{
+    QMutexLocker locker(&d->mutex);
+    d->readAheadSize = size;
+}
+
+void ArchivePageCache::readAround(const QStringList &pageIds, int currentPage)
+{
+    // Anything not yet started is for a page the reader has since moved away from
+    d->readAheadPool.clear();
+
+    QMutexLocker locker(&d->mutex);
+    const QSize size = d->readAheadSize;
+    if (!size.isValid() || pageIds.isEmpty()) {
+        // We don't know what size the viewer wants things at yet, so don't guess
+        return;
+    }
+
+    // Nearest pages first, and reading forwards is more likely than backwards
+    QList<int> pages;
+    for (int i = 1; i <= d->readAhead; ++i) {
+        pages << currentPage + i;
+    }
+    for (int i = 1; i <= d->readBehind; ++i) {
+        pages << currentPage - i;
+    }
+
+    for (int page : std::as_const(pages)) {
+        if (page < 0 || page >= pageIds.count()) {
+            continue;
+        }
+        const QString id = pageIds.at(page);
+        if (id.isEmpty() || d->images.contains(Private::key(id, size))) {
+            continue;
+        }
+        ArchiveBookModel *bookModel = d->bookModel;
+        d->readAheadPool.start([id, size, bookModel]() {
+            // The runnable checks the cache and inserts the decoded page into it itself
+            ArchiveImageRunnable runnable(id, size, bookModel, QString{});
+            runnable.run();
+        });
+    }
+}
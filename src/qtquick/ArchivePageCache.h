@@ -0,0 +1,100 @@
+// SPDX-FileCopyrightText: 2026 Peruse contributors
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#ifndef ARCHIVEPAGECACHE_H
+#define ARCHIVEPAGECACHE_H
+
+#include <QImage>
+#include <QSize>
+#include <QStringList>
+
+class ArchiveBookModel;
+/**
+ * \brief A bounded cache of decoded pages for a single ArchiveBookModel
+ *
+ * Pages are keyed by their archive entry name and the size they were requested at,
+ * and the cache is limited by the amount of memory the decoded images take up, rather
+ * than the number of pages held. The least recently used pages are dropped first.
+ *
+ * The cache can further read ahead (and behind) of the page being read, by decoding
+ * the pages around it on a small, dedicated thread pool, so page turns can be served
+ * straight from memory.
+ *
+ * All functions are thread safe.
+ */
+class ArchivePageCache
+{
+public:
+    /**
+     * The default memory budget for a single book, in bytes
+     */
+    static constexpr qint64 DefaultMaxBytes = 192 * 1024 * 1024;
+
+    explicit ArchivePageCache(ArchiveBookModel *bookModel, qint64 maxBytes = DefaultMaxBytes);
+    ~ArchivePageCache();
+
+    /**
+     * \brief Look up a decoded page
+     * @param id The archive entry name (or ACBF binary id) of the page
+     * @param requestedSize The size the page was requested at
+     * @param image Will be set to the cached image if one was found
+     * @return True if the page was in the cache
+     */
+    bool find(const QString &id, const QSize &requestedSize, QImage *image) const;
+    /**
+     * \brief Insert a decoded page into the cache
+     *
+     * If the image is larger than the entire budget, it will not be cached.
+     *
+     * @param id The archive entry name (or ACBF binary id) of the page
+     * @param requestedSize The size the page was requested at
+     * @param image The decoded image
+     */
+    void insert(const QString &id, const QSize &requestedSize, const QImage &image);
+    /**
+     * \brief Stop any pending read-ahead and drop all cached pages
+     *
+     * This will block until any read-ahead currently being decoded has completed,
+     * and must be called before the archive the pages come from is closed.
+     */
+    void clear();
+
+    /**
+     * @return The maximum amount of memory, in bytes, the cache will hold on to
+     */
+    qint64 maxBytes() const;
+    /**
+     * \brief Set the maximum amount of memory, in bytes, the cache will hold on to
+     */
+    void setMaxBytes(qint64 maxBytes);
+
+    /**
+     * \brief Set how many pages to read ahead of, and behind, the current page
+     * @param ahead The number of pages following the current page to decode
+     * @param behind The number of pages preceding the current page to decode
+     */
+    void setReadAhead(int ahead, int behind);
+    /**
+     * \brief The size at which pages should be read ahead
+     *
+     * This should be set to the size the viewer requests the current page at,
+     * which will commonly be the last size requested for the current page.
+     */
+    void setReadAheadSize(const QSize &size);
+    /**
+     * \brief Decode the pages surrounding the current page in the background
+     *
+     * Any read-ahead which is still waiting to be decoded from a previous call
+     * is dropped, so the pages nearest the reader are always decoded first.
+     *
+     * @param pageIds The archive entry names of all the pages in the book, in reading order
+     * @param currentPage The index of the page currently being read
+     */
+    void readAround(const QStringList &pageIds, int currentPage);
+
+private:
+    class Private;
+    Private *d;
+};
+
+#endif // ARCHIVEPAGECACHE_H
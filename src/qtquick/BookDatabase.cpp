@@ -30,55 +30,137 @@
 #include <QStandardPaths>
 
 #include <QDir>
+#include <QHash>
+#include <QSet>
+#include <QThread>
+#include <QTimer>
+
+#include <functional>
 
 #include <qtquick_debug.h>
 
 class BookDatabase::Private
 {
 public:
-    Private()
+    Private(BookDatabase *qq)
+        : q(qq)
     {
-        db = QSqlDatabase::addDatabase("QSQLITE");
-
         QDir location{QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)};
         if (!location.exists())
             location.mkpath(".");
 
         dbfile = location.absoluteFilePath("library.sqlite");
-        db.setDatabaseName(dbfile);
+        connectionName = QString("peruse-library-%1").arg(quintptr(qq));
+
+        // Everything touching the connection happens in the context of the worker object, on the worker thread
+        worker = new QObject;
+        worker->moveToThread(&thread);
+        updateTimer = new QTimer;
+        updateTimer->setSingleShot(true);
+        updateTimer->setInterval(500);
+        updateTimer->moveToThread(&thread);
+        QObject::connect(updateTimer, &QTimer::timeout, worker, [this]() {
+            flushUpdates();
+        });
+        thread.setObjectName("BookDatabase");
+        thread.start();
+    }
+    ~Private()
+    {
+        QMetaObject::invokeMethod(
+            worker,
+            [this]() {
+                updateTimer->stop();
+                flushUpdates();
+                closeDb();
+            },
+            Qt::BlockingQueuedConnection);
+        thread.quit();
+        thread.wait();
+        delete updateTimer;
+        delete worker;
+        QSqlDatabase::removeDatabase(connectionName);
     }
+    BookDatabase *q;
+
+    QThread thread;
+    QObject *worker;
+    QTimer *updateTimer;
+
+    /**
+     * Queue up some work to happen on the worker thread. Work happens in the order it was queued.
+     */
+    void run(std::function<void()> work)
+    {
+        QMetaObject::invokeMethod(worker, std::move(work), Qt::QueuedConnection);
+    }
+
+    // Everything below here must only be used on the worker thread
 
     QSqlDatabase db;
+    QString connectionName;
     QString dbfile;
     QStringList fieldNames;
-
+    // Prepared statements, keyed by their sql, kept around for as long as the connection is open
+    QHash<QString, QSqlQuery> queries;
+    // Updates waiting to be written, by filename and then property, so repeated updates to the same
+    // property (such as the current page while reading) end up as a single write
+    QHash<QString, QHash<QString, QVariant>> pendingUpdates;
+    // The books which have a cover in the cover atlas, as of the last time the books were loaded
+    QSet<QString> atlasCovers;
+
+    /**
+     * Opens the connection the first time it is called, and leaves it open until the database is destroyed.
+     */
     bool prepareDb()
     {
-        if (!db.open()) {
-            qCDebug(QTQUICK_LOG) << "Failed to open the book database file" << dbfile << db.lastError();
-            return false;
+        if (db.isOpen() && !fieldNames.isEmpty()) {
+            return true;
+        }
+        if (!db.isValid()) {
+            // The connection belongs to the thread which created it, so this must happen on the worker thread
+            db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+            db.setDatabaseName(dbfile);
+        }
+        if (!db.isOpen()) {
+            if (!db.open()) {
+                qCDebug(QTQUICK_LOG) << "Failed to open the book database file" << dbfile << db.lastError();
+                return false;
+            }
+            // Write-ahead logging means readers and the writer do not block each other, and
+            // with it a normal sync is still safe against corruption, and avoids an fsync per commit
+            QSqlQuery pragmas(db);
+            const QStringList statements{QStringLiteral("PRAGMA journal_mode=WAL"),
+                                         QStringLiteral("PRAGMA synchronous=NORMAL"),
+                                         QStringLiteral("PRAGMA temp_store=MEMORY"),
+                                         QStringLiteral("PRAGMA cache_size=-16000")};
+            for (const QString &statement : statements) {
+                if (!pragmas.exec(statement)) {
+                    qCDebug(QTQUICK_LOG) << "Failed to set up the database with" << statement << pragmas.lastError();
+                }
+            }
         }
 
         QStringList tables = db.tables();
         if (tables.contains("books", Qt::CaseInsensitive)) {
             if (fieldNames.isEmpty()) {
-                QSqlQuery qu("SELECT * FROM books");
+                QSqlQuery qu("SELECT * FROM books", db);
                 for (int i = 0; i < qu.record().count(); i++) {
                     fieldNames.append(qu.record().fieldName(i));
                 }
                 qCDebug(QTQUICK_LOG) << Q_FUNC_INFO << ": opening database with following fieldNames:" << fieldNames;
             }
-            return true;
+            return migrate();
         }
 
-        QSqlQuery q;
+        QSqlQuery createTable(db);
         QStringList entryNames;
         entryNames << "fileName varchar primary key" << "fileTitle varchar" << "title varchar" << "genres varchar"
                    << "keywords varchar" << "characters varchar" << "description varchar" << "series varchar"
                    << "seriesNumbers varchar" << "seriesVolumes varchar" << "author varchar" << "publisher varchar"
                    << "created datetime" << "lastOpenedTime datetime" << "totalPages integer" << "currentPage integer"
                    << "thumbnail varchar" << "comment varchar" << "tags varchar" << "rating varchar";
-        if (!q.exec(QString("create table books(" + entryNames.join(", ") + ")"))) {
+        if (!createTable.exec(QString("create table books(" + entryNames.join(", ") + ")"))) {
             qCDebug(QTQUICK_LOG) << "Database could not create the table books";
             return false;
         }
@@ -88,57 +170,374 @@ public:
         }
         qCDebug(QTQUICK_LOG) << Q_FUNC_INFO << ": making database with following fieldNames:" << fieldNames;
 
+        return migrate();
+    }
+
+    /**
+     * The categories which are held in their own table, with one row per book and category name
+     */
+    static QList<Category> junctionCategories()
+    {
+        return {AuthorCategory, SeriesCategory, GenreCategory, KeywordCategory, CharacterCategory, TagCategory};
+    }
+
+    static QString categoryTable(Category category)
+    {
+        switch (category) {
+        case AuthorCategory:
+            return QStringLiteral("book_author");
+        case SeriesCategory:
+            return QStringLiteral("book_series");
+        case GenreCategory:
+            return QStringLiteral("book_genre");
+        case KeywordCategory:
+            return QStringLiteral("book_keyword");
+        case CharacterCategory:
+            return QStringLiteral("book_character");
+        case TagCategory:
+            return QStringLiteral("book_tag");
+        case PublisherCategory:
+            break;
+        }
+        return QString();
+    }
+
+    /**
+     * The column in the books table which holds the same information as the category's table, in the comma-joined form
+     */
+    static Category categoryForColumn(const QString &column, bool *isCategory)
+    {
+        static const QHash<QString, Category> categories{{QStringLiteral("author"), AuthorCategory},
+                                                         {QStringLiteral("series"), SeriesCategory},
+                                                         {QStringLiteral("genres"), GenreCategory},
+                                                         {QStringLiteral("keywords"), KeywordCategory},
+                                                         {QStringLiteral("characters"), CharacterCategory},
+                                                         {QStringLiteral("tags"), TagCategory}};
+        *isCategory = categories.contains(column);
+        return categories.value(column);
+    }
+
+    /**
+     * Brings the schema up to date. The version of the schema is kept in sqlite's user_version.
+     *
+     * Version 1 adds a table for each category a book can be in several of (authors, series and so on),
+     * so categories can be queried using indices rather than by splitting up the comma-joined columns
+     * in the books table. The columns in the books table are kept up to date as well.
+     *
+     * Version 2 makes each book and name pair unique in those tables.
+     */
+    bool migrate()
+    {
+        QSqlQuery migration(db);
+        migration.exec("PRAGMA user_version");
+        const int version = migration.next() ? migration.value(0).toInt() : 0;
+        migration.finish();
+        if (version < 1 && !migrateToVersion1()) {
+            return false;
+        }
+        if (version < 2 && !migrateToVersion2()) {
+            return false;
+        }
         return true;
     }
 
+    bool migrateToVersion1()
+    {
+        qCDebug(QTQUICK_LOG) << "Migrating the book database to schema version 1";
+        QSqlQuery migration(db);
+
+        db.transaction();
+        QStringList statements;
+        for (Category category : junctionCategories()) {
+            const QString table = categoryTable(category);
+            if (category == SeriesCategory) {
+                statements << QString("CREATE TABLE IF NOT EXISTS %1(fileName varchar not null, name varchar not null, number integer, volume integer)").arg(table);
+            } else {
+                statements << QString("CREATE TABLE IF NOT EXISTS %1(fileName varchar not null, name varchar not null)").arg(table);
+            }
+            statements << QString("CREATE INDEX IF NOT EXISTS %1_name ON %1(name)").arg(table);
+            statements << QString("CREATE INDEX IF NOT EXISTS %1_fileName ON %1(fileName)").arg(table);
+        }
+        statements << QStringLiteral("CREATE INDEX IF NOT EXISTS books_publisher ON books(publisher)");
+        for (const QString &statement : std::as_const(statements)) {
+            if (!migration.exec(statement)) {
+                qCDebug(QTQUICK_LOG) << "Failed to migrate the book database" << statement << migration.lastError();
+                db.rollback();
+                return false;
+            }
+        }
+
+        // Fill the new tables in from what is already in the books table
+        QSqlQuery existing(db);
+        existing.setForwardOnly(true);
+        existing.exec("SELECT fileName, author, series, seriesNumbers, seriesVolumes, genres, keywords, characters, tags FROM books");
+        while (existing.next()) {
+            const QString fileName = existing.value(0).toString();
+            insertCategory(fileName, AuthorCategory, existing.value(1).toString().split(",", Qt::SkipEmptyParts));
+            insertCategory(fileName,
+                           SeriesCategory,
+                           existing.value(2).toString().split(",", Qt::SkipEmptyParts),
+                           existing.value(3).toString().split(",", Qt::SkipEmptyParts),
+                           existing.value(4).toString().split(",", Qt::SkipEmptyParts));
+            insertCategory(fileName, GenreCategory, existing.value(5).toString().split(",", Qt::SkipEmptyParts));
+            insertCategory(fileName, KeywordCategory, existing.value(6).toString().split(",", Qt::SkipEmptyParts));
+            insertCategory(fileName, CharacterCategory, existing.value(7).toString().split(",", Qt::SkipEmptyParts));
+            insertCategory(fileName, TagCategory, existing.value(8).toString().split(",", Qt::SkipEmptyParts));
+        }
+        existing.finish();
+
+        migration.exec("PRAGMA user_version = 1");
+        return db.commit();
+    }
+
+    bool migrateToVersion2()
+    {
+        qCDebug(QTQUICK_LOG) << "Migrating the book database to schema version 2";
+        QSqlQuery migration(db);
+        db.transaction();
+        QStringList statements;
+        for (Category category : junctionCategories()) {
+            const QString table = categoryTable(category);
+            // Get rid of any duplicates which have crept in, or the unique index cannot be created
+            statements << QString("DELETE FROM %1 WHERE rowid NOT IN (SELECT MIN(rowid) FROM %1 GROUP BY fileName, name)").arg(table);
+            statements << QString("CREATE UNIQUE INDEX IF NOT EXISTS %1_unique ON %1(fileName, name)").arg(table);
+        }
+        statements << QStringLiteral("PRAGMA user_version = 2");
+        for (const QString &statement : std::as_const(statements)) {
+            if (!migration.exec(statement)) {
+                qCDebug(QTQUICK_LOG) << "Failed to migrate the book database" << statement << migration.lastError();
+                db.rollback();
+                return false;
+            }
+        }
+        return db.commit();
+    }
+
+    /**
+     * Replace the book's rows in the given category's table with the given names
+     */
+    void writeCategory(const QString &fileName,
+                       Category category,
+                       const QStringList &names,
+                       const QStringList &numbers = QStringList(),
+                       const QStringList &volumes = QStringList())
+    {
+        QSqlQuery &clear = query(QString("DELETE FROM %1 WHERE fileName=:filename").arg(categoryTable(category)));
+        clear.bindValue(":filename", fileName);
+        clear.exec();
+        clear.finish();
+        insertCategory(fileName, category, names, numbers, volumes);
+    }
+
+    /**
+     * Add rows for the book to the given category's table, one for each of the given names
+     */
+    void insertCategory(const QString &fileName,
+                        Category category,
+                        const QStringList &names,
+                        const QStringList &numbers = QStringList(),
+                        const QStringList &volumes = QStringList())
+    {
+        if (names.isEmpty()) {
+            return;
+        }
+        const QString table = categoryTable(category);
+        if (category == SeriesCategory) {
+            QSqlQuery &insert = query(QString("INSERT OR IGNORE INTO %1 (fileName, name, number, volume) VALUES (:filename, :name, :number, :volume)").arg(table));
+            for (int i = 0; i < names.count(); ++i) {
+                insert.bindValue(":filename", fileName);
+                insert.bindValue(":name", names.at(i));
+                insert.bindValue(":number", numbers.value(i).toInt());
+                insert.bindValue(":volume", volumes.value(i).toInt());
+                insert.exec();
+            }
+            insert.finish();
+        } else {
+            QSqlQuery &insert = query(QString("INSERT OR IGNORE INTO %1 (fileName, name) VALUES (:filename, :name)").arg(table));
+            for (const QString &name : names) {
+                insert.bindValue(":filename", fileName);
+                insert.bindValue(":name", name);
+                insert.exec();
+            }
+            insert.finish();
+        }
+    }
+
+    void insertCategories(const BookEntry &entry)
+    {
+        insertCategory(entry.filename, AuthorCategory, entry.author);
+        insertCategory(entry.filename, SeriesCategory, entry.series, entry.seriesNumbers, entry.seriesVolumes);
+        insertCategory(entry.filename, GenreCategory, entry.genres);
+        insertCategory(entry.filename, KeywordCategory, entry.keywords);
+        insertCategory(entry.filename, CharacterCategory, entry.characters);
+        insertCategory(entry.filename, TagCategory, entry.tags);
+    }
+
+    /**
+     * Remove the books' rows from all the category tables. This is done a good few books to a statement,
+     * rather than a statement per book and table.
+     */
+    void clearCategories(const QStringList &fileNames)
+    {
+        const int chunkSize = 100;
+        const QString placeholders = QStringList(chunkSize, QStringLiteral("?")).join(", ");
+        for (int start = 0; start < fileNames.count(); start += chunkSize) {
+            QStringList chunk = fileNames.mid(start, chunkSize);
+            // Repeating the last book to fill out the final chunk means there is only the one statement to prepare
+            while (chunk.count() < chunkSize) {
+                chunk << chunk.last();
+            }
+            for (Category category : junctionCategories()) {
+                QSqlQuery &clear = query(QString("DELETE FROM %1 WHERE fileName IN (%2)").arg(categoryTable(category), placeholders));
+                for (int i = 0; i < chunkSize; ++i) {
+                    clear.bindValue(i, chunk.at(i));
+                }
+                if (!clear.exec()) {
+                    qCDebug(QTQUICK_LOG) << "Failed to clear the categories of books in the database" << clear.lastError();
+                }
+                clear.finish();
+            }
+        }
+    }
+
+    /**
+     * Read the categories of books from the category tables, in the order they were written.
+     * The result holds an entry for each book which is in any category, with only the categories filled in.
+     * @param fileName The book to read the categories of, or every book if this is empty
+     */
+    QHash<QString, BookEntry> readCategories(const QString &fileName = QString())
+    {
+        QHash<QString, BookEntry> categories;
+        for (Category category : junctionCategories()) {
+            const QString columns = category == SeriesCategory ? QStringLiteral("fileName, name, number, volume") : QStringLiteral("fileName, name");
+            QSqlQuery &rows = fileName.isEmpty()
+                ? query(QString("SELECT %1 FROM %2 ORDER BY rowid").arg(columns, categoryTable(category)))
+                : query(QString("SELECT %1 FROM %2 WHERE fileName=:filename ORDER BY rowid").arg(columns, categoryTable(category)));
+            if (!fileName.isEmpty()) {
+                rows.bindValue(":filename", fileName);
+            }
+            if (!rows.exec()) {
+                qCDebug(QTQUICK_LOG) << "Failed to read the categories from the database" << rows.lastError();
+            }
+            while (rows.next()) {
+                BookEntry &entry = categories[rows.value(0).toString()];
+                const QString name = rows.value(1).toString();
+                switch (category) {
+                case AuthorCategory:
+                    entry.author << name;
+                    break;
+                case SeriesCategory:
+                    entry.series << name;
+                    entry.seriesNumbers << QString::number(rows.value(2).toInt());
+                    entry.seriesVolumes << QString::number(rows.value(3).toInt());
+                    break;
+                case GenreCategory:
+                    entry.genres << name;
+                    break;
+                case KeywordCategory:
+                    entry.keywords << name;
+                    break;
+                case CharacterCategory:
+                    entry.characters << name;
+                    break;
+                case TagCategory:
+                    entry.tags << name;
+                    break;
+                case PublisherCategory:
+                    break;
+                }
+            }
+            rows.finish();
+        }
+        return categories;
+    }
+
     void closeDb()
     {
+        queries.clear();
         db.close();
+        // Drop our handle on the connection, so it can be removed once the thread is done
+        db = QSqlDatabase();
     }
-};
 
-BookDatabase::BookDatabase(QObject *parent)
-    : QObject(parent)
-    , d(new Private)
-{
-}
+    /**
+     * Returns the prepared statement for the given sql, preparing it the first time it is asked for.
+     */
+    QSqlQuery &query(const QString &sql)
+    {
+        auto it = queries.find(sql);
+        if (it == queries.end()) {
+            QSqlQuery query(db);
+            if (!query.prepare(sql)) {
+                qCDebug(QTQUICK_LOG) << "Failed to prepare the query" << sql << query.lastError();
+            }
+            it = queries.insert(sql, query);
+        }
+        return it.value();
+    }
 
-BookDatabase::~BookDatabase()
-{
-    delete d;
-}
+    QSqlQuery &insertQuery()
+    {
+        QStringList valueNames;
+        for (int i = 0; i < fieldNames.size(); i++) {
+            valueNames.append(QString(":").append(fieldNames.at(i)));
+        }
+        // Books found again (for example after their metadata changed) simply replace the old row
+        return query("INSERT OR REPLACE INTO books (" + fieldNames.join(", ") + ") VALUES (" + valueNames.join(", ") + ")");
+    }
 
-QList<BookEntry> BookDatabase::loadEntries()
-{
-    if (!d->prepareDb()) {
-        return {};
+    static void bindEntry(QSqlQuery &newEntry, const BookEntry &entry)
+    {
+        newEntry.bindValue(":fileName", entry.filename);
+        newEntry.bindValue(":fileTitle", entry.filetitle);
+        newEntry.bindValue(":title", entry.title);
+        newEntry.bindValue(":series", entry.series.join(","));
+        newEntry.bindValue(":author", entry.author.join(","));
+        newEntry.bindValue(":publisher", entry.publisher);
+        newEntry.bindValue(":created", entry.created);
+        newEntry.bindValue(":lastOpenedTime", entry.lastOpenedTime);
+        newEntry.bindValue(":totalPages", entry.totalPages);
+        newEntry.bindValue(":currentPage", entry.currentPage);
+        newEntry.bindValue(":thumbnail", entry.thumbnail);
+        newEntry.bindValue(":description", entry.description.join("\n"));
+        newEntry.bindValue(":comment", entry.comment);
+        newEntry.bindValue(":tags", entry.tags.join(","));
+        newEntry.bindValue(":rating", entry.rating);
+        newEntry.bindValue(":seriesNumbers", entry.seriesNumbers.join(","));
+        newEntry.bindValue(":seriesVolumes", entry.seriesVolumes.join(","));
+        newEntry.bindValue(":genres", entry.genres.join(","));
+        newEntry.bindValue(":keywords", entry.keywords.join(","));
+        newEntry.bindValue(":characters", entry.characters.join(","));
     }
 
-    QList<BookEntry> entries;
-    QStringList entryNames = d->fieldNames;
-    QSqlQuery allEntries("SELECT " + d->fieldNames.join(", ") + " FROM books");
-    while (allEntries.next()) {
+    /**
+     * Constructs an entry from the current row of a query selecting fieldNames from the books table,
+     * and the book's categories as read by readCategories()
+     */
+    BookEntry entryFromQuery(const QSqlQuery &result, const BookEntry &categories) const
+    {
         BookEntry entry;
-        entry.filename = allEntries.value(d->fieldNames.indexOf("fileName")).toString();
-        entry.filetitle = allEntries.value(d->fieldNames.indexOf("fileTitle")).toString();
-        entry.title = allEntries.value(d->fieldNames.indexOf("title")).toString();
-        entry.series = allEntries.value(d->fieldNames.indexOf("series")).toString().split(",", Qt::SkipEmptyParts);
-        entry.author = allEntries.value(d->fieldNames.indexOf("author")).toString().split(",", Qt::SkipEmptyParts);
-        entry.publisher = allEntries.value(d->fieldNames.indexOf("publisher")).toString();
-        entry.created = allEntries.value(d->fieldNames.indexOf("created")).toDateTime();
-        entry.lastOpenedTime = allEntries.value(d->fieldNames.indexOf("lastOpenedTime")).toDateTime();
-        entry.totalPages = allEntries.value(d->fieldNames.indexOf("totalPages")).toInt();
-        entry.currentPage = allEntries.value(d->fieldNames.indexOf("currentPage")).toInt();
-        entry.thumbnail = allEntries.value(d->fieldNames.indexOf("thumbnail")).toString();
-        entry.description = allEntries.value(d->fieldNames.indexOf("description")).toString().split("\n", Qt::SkipEmptyParts);
-        entry.comment = allEntries.value(d->fieldNames.indexOf("comment")).toString();
-        entry.tags = allEntries.value(d->fieldNames.indexOf("tags")).toString().split(",", Qt::SkipEmptyParts);
-        entry.rating = allEntries.value(d->fieldNames.indexOf("rating")).toInt();
-        entry.seriesNumbers = allEntries.value(d->fieldNames.indexOf("seriesNumbers")).toString().split(",", Qt::SkipEmptyParts);
-        entry.seriesVolumes = allEntries.value(d->fieldNames.indexOf("seriesVolumes")).toString().split(",", Qt::SkipEmptyParts);
-        entry.genres = allEntries.value(d->fieldNames.indexOf("genres")).toString().split(",", Qt::SkipEmptyParts);
-        entry.keywords = allEntries.value(d->fieldNames.indexOf("keywords")).toString().split(",", Qt::SkipEmptyParts);
-        entry.characters = allEntries.value(d->fieldNames.indexOf("characters")).toString().split(",", Qt::SkipEmptyParts);
+        entry.filename = result.value(fieldNames.indexOf("fileName")).toString();
+        entry.filetitle = result.value(fieldNames.indexOf("fileTitle")).toString();
+        entry.title = result.value(fieldNames.indexOf("title")).toString();
+        entry.publisher = result.value(fieldNames.indexOf("publisher")).toString();
+        entry.created = result.value(fieldNames.indexOf("created")).toDateTime();
+        entry.lastOpenedTime = result.value(fieldNames.indexOf("lastOpenedTime")).toDateTime();
+        entry.totalPages = result.value(fieldNames.indexOf("totalPages")).toInt();
+        entry.currentPage = result.value(fieldNames.indexOf("currentPage")).toInt();
+        entry.thumbnail = result.value(fieldNames.indexOf("thumbnail")).toString();
+        entry.description = result.value(fieldNames.indexOf("description")).toString().split("\n", Qt::SkipEmptyParts);
+        entry.comment = result.value(fieldNames.indexOf("comment")).toString();
+        entry.rating = result.value(fieldNames.indexOf("rating")).toInt();
+        // The category tables are indexed, and unlike the comma-joined columns, cope with names which contain commas
+        entry.author = categories.author;
+        entry.series = categories.series;
+        entry.seriesNumbers = categories.seriesNumbers;
+        entry.seriesVolumes = categories.seriesVolumes;
+        entry.genres = categories.genres;
+        entry.keywords = categories.keywords;
+        entry.characters = categories.characters;
+        entry.tags = categories.tags;
 
         // Since we may change the thumbnailer between updates, but retain the
         // database, this may break so we need to sanitise in case of pdf...
@@ -149,102 +548,353 @@ QList<BookEntry> BookDatabase::loadEntries()
             entry.thumbnail = QString("image://preview/").append(entry.filename);
 #endif
         }
+        // Covers which are in the atlas are ready to show straight away, without waiting on a thumbnailer.
+        // The atlas may have dropped the cover since (if the book changed, or the atlas was started
+        // afresh), so the url carries the book's usual thumbnail along, for the shelves to fall back on.
+        if (atlasCovers.contains(entry.filename) && entry.thumbnail.startsWith(QStringLiteral("image://"))
+            && !entry.thumbnail.startsWith(QStringLiteral("image://atlascover/"))) {
+            entry.thumbnail = QString("image://atlascover/").append(entry.thumbnail);
+        }
+        return entry;
+    }
 
-        entries.append(entry);
+    /**
+     * Read all the books in the database, passing them on in chunks of the given size as they are read.
+     * @return The filenames of all the books
+     */
+    QStringList readEntries(int chunkSize)
+    {
+        if (!prepareDb()) {
+            return {};
+        }
+
+        // The cover atlas keeps its index in our database, in a table of its own
+        atlasCovers.clear();
+        if (db.tables().contains(QStringLiteral("cover_atlas"), Qt::CaseInsensitive)) {
+            QSqlQuery covers(db);
+            covers.setForwardOnly(true);
+            covers.exec("SELECT fileName FROM cover_atlas");
+            while (covers.next()) {
+                atlasCovers.insert(covers.value(0).toString());
+            }
+        }
+
+        // A pass over each category table is a great deal cheaper than looking up every book's categories in turn
+        const QHash<QString, BookEntry> categories = readCategories();
+
+        QStringList fileNames;
+        QList<BookEntry> entries;
+        entries.reserve(chunkSize);
+        QSqlQuery allEntries(db);
+        // We only ever walk forward through the result, which lets sqlite hand us rows as it finds them
+        allEntries.setForwardOnly(true);
+        allEntries.exec("SELECT " + fieldNames.join(", ") + " FROM books");
+        while (allEntries.next()) {
+            const BookEntry entry = entryFromQuery(allEntries, categories.value(allEntries.value(fieldNames.indexOf("fileName")).toString()));
+            fileNames.append(entry.filename);
+            entries.append(entry);
+            if (entries.count() == chunkSize) {
+                Q_EMIT q->entriesLoaded(entries);
+                entries.clear();
+                entries.reserve(chunkSize);
+            }
+        }
+        if (!entries.isEmpty()) {
+            Q_EMIT q->entriesLoaded(entries);
+        }
+
+        return fileNames;
+    }
+
+    /**
+     * Find which of the given files no longer exist. Rather than a stat per file, this lists
+     * each directory once, which is a great deal cheaper for large libraries (in particular
+     * on network and removable storage).
+     */
+    static QStringList missingFiles(const QStringList &fileNames)
+    {
+        QHash<QString, QStringList> filesByDirectory;
+        for (const QString &fileName : fileNames) {
+            filesByDirectory[fileName.left(fileName.lastIndexOf('/'))] << fileName.mid(fileName.lastIndexOf('/') + 1);
+        }
+
+        QStringList missing;
+        for (auto it = filesByDirectory.constBegin(); it != filesByDirectory.constEnd(); ++it) {
+            const QDir dir(it.key());
+            QSet<QString> present;
+            if (dir.exists()) {
+                const QStringList entries = dir.entryList(QDir::Files | QDir::Hidden | QDir::System);
+                present = QSet<QString>(entries.constBegin(), entries.constEnd());
+            }
+            for (const QString &file : it.value()) {
+                if (!present.contains(file)) {
+                    missing << it.key() + '/' + file;
+                }
+            }
+        }
+        return missing;
+    }
+
+    void writeEntries(const QList<BookEntry> &entries)
+    {
+        if (entries.isEmpty() || !prepareDb()) {
+            return;
+        }
+        qCDebug(QTQUICK_LOG) << "Adding" << entries.count() << "newly discovered books to the database";
+
+        // One transaction for the lot, rather than an implicit one (and a sync) per book
+        db.transaction();
+        QSqlQuery &newEntry = insertQuery();
+        for (const BookEntry &entry : entries) {
+            bindEntry(newEntry, entry);
+            if (!newEntry.exec()) {
+                qCDebug(QTQUICK_LOG) << "Failed to add the book" << entry.filename << "to the database" << newEntry.lastError();
+            }
+        }
+        newEntry.finish();
+        QStringList fileNames;
+        for (const BookEntry &entry : entries) {
+            fileNames << entry.filename;
+        }
+        clearCategories(fileNames);
+        for (const BookEntry &entry : entries) {
+            insertCategories(entry);
+        }
+        db.commit();
+    }
+
+    void deleteEntries(const QStringList &fileNames)
+    {
+        if (fileNames.isEmpty() || !prepareDb()) {
+            return;
+        }
+        qCDebug(QTQUICK_LOG) << "Removing" << fileNames.count() << "books from the database";
+
+        db.transaction();
+        QSqlQuery &removeEntry = query("DELETE FROM books WHERE fileName=:filename");
+        for (const QString &fileName : fileNames) {
+            removeEntry.bindValue(":filename", fileName);
+            if (!removeEntry.exec()) {
+                qCDebug(QTQUICK_LOG) << "Failed to remove the book" << fileName << "from the database" << removeEntry.lastError();
+            }
+        }
+        removeEntry.finish();
+        clearCategories(fileNames);
+        // Letting the atlas know its covers for these books are no longer needed means it can
+        // tell when it is mostly holding unused covers, and start afresh
+        if (db.tables().contains(QStringLiteral("cover_atlas"), Qt::CaseInsensitive)) {
+            QSqlQuery &removeCover = query("DELETE FROM cover_atlas WHERE fileName=:filename");
+            for (const QString &fileName : fileNames) {
+                removeCover.bindValue(":filename", fileName);
+                removeCover.exec();
+            }
+            removeCover.finish();
+        }
+        db.commit();
+    }
+
+    void writeUpdate(const QString &fileName, const QString &property, const QVariant &value)
+    {
+        // qCDebug(QTQUICK_LOG) << "Updating book in the database" << fileName << property << value;
+
+        if (!fieldNames.contains(property)) {
+            return;
+        }
+
+        QStringList stringListValues;
+        stringListValues << "series" << "author" << "characters" << "genres" << "keywords" << "tags";
+        QString val;
+        if (stringListValues.contains(property)) {
+            val = value.toStringList().join(",");
+        } else if (property == "description") {
+            val = value.toStringList().join("\n");
+        }
+
+        QSqlQuery &updateEntry = query(QString("UPDATE books SET %1=:value WHERE fileName=:filename ").arg(property));
+        updateEntry.bindValue(":value", value);
+        if (!val.isEmpty()) {
+            updateEntry.bindValue(":value", val);
+        }
+        updateEntry.bindValue(":filename", fileName);
+        if (!updateEntry.exec()) {
+            qCDebug(QTQUICK_LOG) << updateEntry.lastError();
+            qCDebug(QTQUICK_LOG) << "Query failed, string:" << updateEntry.lastQuery();
+            qCDebug(QTQUICK_LOG) << updateEntry.boundValue(":value");
+            qCDebug(QTQUICK_LOG) << updateEntry.boundValue(":filename");
+            qCDebug(QTQUICK_LOG) << db.lastError();
+        }
+        updateEntry.finish();
+
+        bool isCategory = false;
+        const Category category = categoryForColumn(property, &isCategory);
+        if (isCategory) {
+            writeCategory(fileName, category, value.toStringList());
+        }
+    }
+
+    QVariantMap readCategoryCounts(Category category)
+    {
+        QVariantMap counts;
+        if (!prepareDb()) {
+            return counts;
+        }
+        QSqlQuery &countQuery = category == PublisherCategory
+            ? query("SELECT publisher, COUNT(*) FROM books GROUP BY publisher")
+            : query(QString("SELECT name, COUNT(*) FROM %1 GROUP BY name").arg(categoryTable(category)));
+        countQuery.exec();
+        while (countQuery.next()) {
+            counts.insert(countQuery.value(0).toString(), countQuery.value(1).toInt());
+        }
+        countQuery.finish();
+        return counts;
     }
 
-    d->closeDb();
-    return entries;
+    QList<BookEntry> readCategoryMembers(Category category, const QString &name, int offset, int limit)
+    {
+        QList<BookEntry> entries;
+        if (!prepareDb()) {
+            return entries;
+        }
+        QStringList columns;
+        for (const QString &field : std::as_const(fieldNames)) {
+            columns << QString("b.").append(field);
+        }
+        QString sql;
+        if (category == PublisherCategory) {
+            sql = QString("SELECT %1 FROM books b WHERE b.publisher = :name ORDER BY b.title COLLATE NOCASE LIMIT :limit OFFSET :offset");
+        } else if (category == SeriesCategory) {
+            sql = QString("SELECT %1 FROM books b JOIN %2 j ON j.fileName = b.fileName WHERE j.name = :name "
+                          "ORDER BY j.volume, j.number, b.title COLLATE NOCASE LIMIT :limit OFFSET :offset")
+                      .arg("%1", categoryTable(category));
+        } else {
+            sql = QString("SELECT %1 FROM books b JOIN %2 j ON j.fileName = b.fileName WHERE j.name = :name "
+                          "ORDER BY b.title COLLATE NOCASE LIMIT :limit OFFSET :offset")
+                      .arg("%1", categoryTable(category));
+        }
+        QSqlQuery &members = query(sql.arg(columns.join(", ")));
+        members.bindValue(":name", name);
+        // A negative limit means no limit to sqlite
+        members.bindValue(":limit", limit);
+        members.bindValue(":offset", qMax(0, offset));
+        members.exec();
+        while (members.next()) {
+            // This is only a page of books, so looking each one's categories up through the indices is cheap
+            const QString fileName = members.value(fieldNames.indexOf("fileName")).toString();
+            entries << entryFromQuery(members, readCategories(fileName).value(fileName));
+        }
+        members.finish();
+        return entries;
+    }
+
+    /**
+     * Write out all pending updates. This is done before any other work, so that work
+     * always sees the most recent state of the books.
+     */
+    void flushUpdates()
+    {
+        if (pendingUpdates.isEmpty() || !prepareDb()) {
+            return;
+        }
+        db.transaction();
+        for (auto book = pendingUpdates.constBegin(); book != pendingUpdates.constEnd(); ++book) {
+            for (auto update = book.value().constBegin(); update != book.value().constEnd(); ++update) {
+                writeUpdate(book.key(), update.key(), update.value());
+            }
+        }
+        db.commit();
+        pendingUpdates.clear();
+    }
+};
+
+BookDatabase::BookDatabase(QObject *parent)
+    : QObject(parent)
+    , d(new Private(this))
+{
 }
 
-void BookDatabase::addEntry(const BookEntry &entry)
+BookDatabase::~BookDatabase()
 {
-    if (!d->prepareDb()) {
-        return;
-    }
-    qCDebug(QTQUICK_LOG) << "Adding newly discovered book to the database" << entry.filename;
-
-    QStringList valueNames;
-    for (int i = 0; i < d->fieldNames.size(); i++) {
-        valueNames.append(QString(":").append(d->fieldNames.at(i)));
-    }
-    QSqlQuery newEntry;
-    newEntry.prepare("INSERT INTO books (" + d->fieldNames.join(", ") + ") "
-                     "VALUES (" + valueNames.join(", ") + ")");
-    newEntry.bindValue(":fileName", entry.filename);
-    newEntry.bindValue(":fileTitle", entry.filetitle);
-    newEntry.bindValue(":title", entry.title);
-    newEntry.bindValue(":series", entry.series.join(","));
-    newEntry.bindValue(":author", entry.author.join(","));
-    newEntry.bindValue(":publisher", entry.publisher);
-    newEntry.bindValue(":publisher", entry.publisher);
-    newEntry.bindValue(":created", entry.created);
-    newEntry.bindValue(":lastOpenedTime", entry.lastOpenedTime);
-    newEntry.bindValue(":totalPages", entry.totalPages);
-    newEntry.bindValue(":currentPage", entry.currentPage);
-    newEntry.bindValue(":thumbnail", entry.thumbnail);
-    newEntry.bindValue(":description", entry.description.join("\n"));
-    newEntry.bindValue(":comment", entry.comment);
-    newEntry.bindValue(":tags", entry.tags.join(","));
-    newEntry.bindValue(":rating", entry.rating);
-    newEntry.bindValue(":seriesNumbers", entry.seriesNumbers.join(","));
-    newEntry.bindValue(":seriesVolumes", entry.seriesVolumes.join(","));
-    newEntry.bindValue(":genres", entry.genres.join(","));
-    newEntry.bindValue(":keywords", entry.keywords.join(","));
-    newEntry.bindValue(":characters", entry.characters.join(","));
-    newEntry.exec();
-
-    d->closeDb();
+    delete d;
 }
 
-void BookDatabase::removeEntry(const BookEntry &entry)
+void BookDatabase::loadEntries()
 {
-    if (!d->prepareDb()) {
-        return;
-    }
-    qCDebug(QTQUICK_LOG) << "Removing book from the database" << entry.filename;
+    d->run([this]() {
+        d->flushUpdates();
+        // Signals emitted on the worker thread are queued to receivers living on other threads
+        const QStringList fileNames = d->readEntries(500);
+        Q_EMIT entriesLoadingFinished();
+
+        const QStringList missing = Private::missingFiles(fileNames);
+        if (!missing.isEmpty()) {
+            qCDebug(QTQUICK_LOG) << missing.count() << "books in the database no longer exist";
+            d->deleteEntries(missing);
+            Q_EMIT entriesMissing(missing);
+        }
+    });
+}
 
-    QSqlQuery removeEntry;
-    removeEntry.prepare("DELETE FROM books WHERE fileName='" + entry.filename + "';");
-    removeEntry.exec();
+void BookDatabase::loadCategoryCounts(Category category)
+{
+    d->run([this, category]() {
+        d->flushUpdates();
+        Q_EMIT categoryCountsLoaded(category, d->readCategoryCounts(category));
+    });
+}
 
-    d->closeDb();
+void BookDatabase::loadCategoryMembers(Category category, const QString &name, int offset, int limit)
+{
+    d->run([this, category, name, offset, limit]() {
+        d->flushUpdates();
+        Q_EMIT categoryMembersLoaded(category, name, offset, d->readCategoryMembers(category, name, offset, limit));
+    });
 }
 
-void BookDatabase::updateEntry(QString fileName, QString property, QVariant value)
+void BookDatabase::addEntry(const BookEntry &entry)
 {
-    if (!d->prepareDb()) {
-        return;
-    }
-    // qCDebug(QTQUICK_LOG) << "Updating book in the database" << fileName << property << value;
+    addEntries({entry});
+}
 
-    if (!d->fieldNames.contains(property)) {
+void BookDatabase::addEntries(const QList<BookEntry> &entries)
+{
+    if (entries.isEmpty()) {
         return;
     }
+    d->run([this, entries]() {
+        d->flushUpdates();
+        d->writeEntries(entries);
+    });
+}
 
-    QStringList stringListValues;
-    stringListValues << "series" << "author" << "characters" << "genres" << "keywords" << "tags";
-    QString val;
-    if (stringListValues.contains(property)) {
-        val = value.toStringList().join(",");
-    } else if (property == "description") {
-        val = value.toStringList().join("\n");
-    }
+void BookDatabase::removeEntry(const BookEntry &entry)
+{
+    removeEntries({entry});
+}
 
-    QSqlQuery updateEntry;
-    updateEntry.prepare(QString("UPDATE books SET %1=:value WHERE fileName=:filename ").arg(property));
-    updateEntry.bindValue(":value", value);
-    if (!val.isEmpty()) {
-        updateEntry.bindValue(":value", val);
+void BookDatabase::removeEntries(const QList<BookEntry> &entries)
+{
+    if (entries.isEmpty()) {
+        return;
     }
-    updateEntry.bindValue(":filename", fileName);
-    if (!updateEntry.exec()) {
-        qCDebug(QTQUICK_LOG) << updateEntry.lastError();
-        qCDebug(QTQUICK_LOG) << "Query failed, string:" << updateEntry.lastQuery();
-        qCDebug(QTQUICK_LOG) << updateEntry.boundValue(":value");
-        qCDebug(QTQUICK_LOG) << updateEntry.boundValue(":filename");
-        qCDebug(QTQUICK_LOG) << d->db.lastError();
+    QStringList fileNames;
+    for (const BookEntry &entry : entries) {
+        fileNames << entry.filename;
     }
+    d->run([this, fileNames]() {
+        for (const QString &fileName : fileNames) {
+            d->pendingUpdates.remove(fileName);
+        }
+        d->flushUpdates();
+        d->deleteEntries(fileNames);
+    });
+}
 
-    d->closeDb();
+void BookDatabase::updateEntry(QString fileName, QString property, QVariant value)
+{
+    d->run([this, fileName, property, value]() {
+        d->pendingUpdates[fileName][property] = value;
+        if (!d->updateTimer->isActive()) {
+            d->updateTimer->start();
+        }
+    });
 }
@@ -23,14 +23,29 @@
 #define BOOKDATABASE_H
 
 #include <QObject>
+#include <QVariantMap>
+
+#include "CategoryEntriesModel.h"
 
-struct BookEntry;
 /**
  * \brief A Class to hold a cache of known books to reduce the amount of time spent indexing.
  *
  * BookDatabase handles holding the conversion between SQL entry and
  * BookEntry structs.
  *
+ * Beyond the books themselves, the categories a book can be in several of (authors,
+ * series, genres, keywords, characters and tags) are kept in their own indexed tables,
+ * which lets categories be counted and paged through without loading every book. Books
+ * loaded from the database take their categories from those tables as well.
+ *
+ * The database also holds the index of the cover atlas (see CoverAtlas in the thumbnail
+ * module), and books which have a cover in the atlas are given an image://atlascover/ thumbnail,
+ * which is followed by the url of the thumbnail the book would otherwise have had.
+ *
+ * All work on the database happens on a worker thread which owns the connection,
+ * in the order it was requested. Updates to the same book are held back for a
+ * short while, so that a rapid series of updates results in a single write.
+ *
  * The BookEntry struct is defined in CategoryEntriesModel.
  */
 class BookDatabase : public QObject
@@ -41,19 +56,99 @@ public:
     ~BookDatabase() override;
 
     /**
-     * @return a list of all known books in the database.
+     * \brief The categories books can be queried by
+     */
+    enum Category {
+        AuthorCategory = 0,
+        SeriesCategory,
+        GenreCategory,
+        KeywordCategory,
+        CharacterCategory,
+        TagCategory,
+        PublisherCategory,
+    };
+    Q_ENUM(Category)
+
+    /**
+     * \brief Load all known books from the database.
+     *
+     * This happens asynchronously. The books are passed on in chunks through entriesLoaded()
+     * as they are read, followed by entriesLoadingFinished(). After that, the database checks
+     * whether the files still exist, removes those which do not, and reports them through
+     * entriesMissing().
+     */
+    void loadEntries();
+    /**
+     * \brief Fired for each chunk of books read by loadEntries().
+     * @param entries The books read since the last chunk.
+     */
+    Q_SIGNAL void entriesLoaded(const QList<BookEntry> &entries);
+    /**
+     * \brief Fired when loadEntries() has passed on all the books in the database.
+     */
+    Q_SIGNAL void entriesLoadingFinished();
+    /**
+     * \brief Fired when books loaded by loadEntries() turn out to no longer exist.
+     *
+     * These have already been removed from the database.
+     *
+     * @param fileNames The filenames of the books which no longer exist.
      */
-    QList<BookEntry> loadEntries();
+    Q_SIGNAL void entriesMissing(const QStringList &fileNames);
     /**
-     * \brief Add a new book to the cache.
+     * \brief Count the books in each category of the given kind.
+     *
+     * This happens asynchronously, and the result is passed on through categoryCountsLoaded().
+     *
+     * @param category The kind of category to count the books in.
+     */
+    void loadCategoryCounts(Category category);
+    /**
+     * \brief Fired when loadCategoryCounts() has completed.
+     * @param category The kind of category which was counted.
+     * @param counts The number of books in each category, by the name of the category.
+     */
+    Q_SIGNAL void categoryCountsLoaded(BookDatabase::Category category, const QVariantMap &counts);
+    /**
+     * \brief Load a page of the books in a specific category.
+     *
+     * Books are ordered by title, or for series by their volume and number. This happens
+     * asynchronously, and the result is passed on through categoryMembersLoaded().
+     *
+     * @param category The kind of category to look in.
+     * @param name The name of the category, for example an author's name.
+     * @param offset How many books to skip before the first one to load.
+     * @param limit The largest number of books to load. Pass -1 to load all of them.
+     */
+    void loadCategoryMembers(Category category, const QString &name, int offset = 0, int limit = -1);
+    /**
+     * \brief Fired when loadCategoryMembers() has completed.
+     * @param category The kind of category the books were loaded from.
+     * @param name The name of the category.
+     * @param offset The offset the books were loaded from.
+     * @param entries The books which were loaded.
+     */
+    Q_SIGNAL void categoryMembersLoaded(BookDatabase::Category category, const QString &name, int offset, const QList<BookEntry> &entries);
+    /**
+     * \brief Add a new book to the cache, replacing any existing entry for the same file.
      * @param entry The entry to add.
      */
     void addEntry(const BookEntry &entry);
+    /**
+     * \brief Add a number of new books to the cache in a single transaction.
+     * @param entries The entries to add.
+     */
+    void addEntries(const QList<BookEntry> &entries);
     /**
      * @brief remove an entry by filename from the cache.
      * @param entry the entry to remove.
      */
     void removeEntry(const BookEntry &entry);
+    /**
+     * @brief remove a number of entries by filename from the cache in a single transaction.
+     * @param entries the entries to remove.
+     */
+    void removeEntries(const QList<BookEntry> &entries);
     /**
      * @brief updateEntry update an entry by filename.
      * @param fileName the filename of the entry to update.
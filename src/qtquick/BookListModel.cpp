@@ -21,78 +21,18 @@
 
 #include "BookListModel.h"
 
-#include "ArchiveBookModel.h"
 #include "BookDatabase.h"
+#include "BookMetadataIngester.h"
 #include "CategoryEntriesModel.h"
 
-#include "AcbfAuthor.h"
-#include "AcbfBookinfo.h"
-#include "AcbfDocument.h"
-#include "AcbfSequence.h"
-
-#include <KFileMetaData/ExtractionResult>
-#include <KFileMetaData/ExtractorCollection>
-#include <KFileMetaData/Properties>
-#include <KFileMetaData/PropertyInfo>
-#include <KFileMetaData/UserMetaData>
 #include <kio/deletejob.h>
 
-#include <QCoreApplication>
 #include <QDir>
-#include <QMimeDatabase>
-#include <QTimer>
+#include <QSet>
 #include <QUrl>
 
 #include <qtquick_debug.h>
 
-using namespace Qt::StringLiterals;
-
-class PeruseExtractionResult : public KFileMetaData::ExtractionResult
-{
-public:
-    PeruseExtractionResult(const QString &url, const QString &mimetype)
-        : KFileMetaData::ExtractionResult(url, mimetype, KFileMetaData::ExtractionResult::ExtractMetaData)
-    {
-    }
-
-    void add(KFileMetaData::Property::Property property, const QVariant &value) override
-    {
-        if (property == KFileMetaData::Property::Author) {
-            authors.append(value.toString());
-        }
-
-        if (property == KFileMetaData::Property::Publisher) {
-            publishers.append(value.toString());
-        }
-
-        if (property == KFileMetaData::Property::Subject) {
-            genres.append(value.toString());
-        }
-
-        if (property == KFileMetaData::Property::Description) {
-            description = value.toString();
-        }
-
-        if (property == KFileMetaData::Property::CreationDate) {
-            creation = value.toDateTime();
-        }
-    }
-
-    void addType(KFileMetaData::Type::Type type) override
-    {
-    }
-
-    void append(const QString &text) override
-    {
-    }
-
-    QStringList authors;
-    QStringList publishers;
-    QStringList genres;
-    QString description;
-    QDateTime creation;
-};
-
 class BookListModel::Private
 {
 public:
@@ -108,12 +48,17 @@ public:
         , cacheLoaded(false)
     {
         db = new BookDatabase();
+        ingester = new BookMetadataIngester();
     };
     ~Private()
     {
-        db->deleteLater();
+        delete ingester;
+        // Deleting the database makes sure any pending writes make it to disk
+        delete db;
     }
     QList<BookEntry> entries;
+    // The filenames of everything in entries, so books reported more than once are only added the once
+    QSet<QString> files;
 
     QAbstractListModel *contentModel;
     CategoryEntriesModel *titleCategoryModel;
@@ -125,6 +70,7 @@ public:
     CategoryEntriesModel *folderCategoryModel;
 
     BookDatabase *db;
+    BookMetadataIngester *ingester;
     bool cacheLoaded;
 
     void initializeSubModels(BookListModel *q)
@@ -173,62 +119,90 @@ public:
         }
     }
 
-    void addEntry(BookListModel *q, const BookEntry &entry)
+    void addEntries(BookListModel *q, const QList<BookEntry> &entriesToAdd)
     {
-        entries.append(entry);
-        q->append(entry);
-        titleCategoryModel->addCategoryEntry(entry.title.left(1).toUpper(), entry);
-        for (int i = 0; i < entry.author.size(); i++) {
-            authorCategoryModel->addCategoryEntry(entry.author.at(i), entry);
-        }
-        for (int i = 0; i < entry.series.size(); i++) {
-            seriesCategoryModel->addCategoryEntry(entry.series.at(i), entry, SeriesRole);
-        }
-        if (newlyAddedCategoryModel->indexOfFile(entry.filename) == -1) {
-            newlyAddedCategoryModel->append(entry, CreatedRole);
-        }
-        publisherCategoryModel->addCategoryEntry(entry.publisher, entry);
-        QUrl url(entry.filename.left(entry.filename.lastIndexOf("/")));
-        folderCategoryModel->addCategoryEntry(url.path().mid(1), entry);
-        if (folderCategoryModel->indexOfFile(entry.filename) == -1) {
-            folderCategoryModel->append(entry);
-        }
-        for (int i = 0; i < entry.genres.size(); i++) {
-            keywordCategoryModel->addCategoryEntry(QString("Genre/").append(entry.genres.at(i)), entry, GenreRole);
+        // A book can be reported again, such as by a rescan racing the cache being loaded, or being
+        // picked up again by the watcher, and like the category models, the list holds each book once
+        QList<BookEntry> newEntries;
+        newEntries.reserve(entriesToAdd.count());
+        for (const BookEntry &entry : entriesToAdd) {
+            if (!files.contains(entry.filename)) {
+                files.insert(entry.filename);
+                newEntries << entry;
+            }
         }
-        for (int i = 0; i < entry.characters.size(); i++) {
-            keywordCategoryModel->addCategoryEntry(QString("Characters/").append(entry.characters.at(i)), entry, GenreRole);
+        if (newEntries.isEmpty()) {
+            return;
         }
-        for (int i = 0; i < entry.keywords.size(); i++) {
-            keywordCategoryModel->addCategoryEntry(QString("Keywords/").append(entry.keywords.at(i)), entry, GenreRole);
+        // Collect everything per category tree, so each model gets a single batch of changes
+        QList<QPair<QString, BookEntry>> titles;
+        QList<QPair<QString, BookEntry>> authors;
+        QList<QPair<QString, BookEntry>> series;
+        QList<QPair<QString, BookEntry>> publishers;
+        QList<QPair<QString, BookEntry>> folders;
+        QList<QPair<QString, BookEntry>> keywords;
+        for (const BookEntry &entry : newEntries) {
+            titles << qMakePair(entry.title.left(1).toUpper(), entry);
+            for (int i = 0; i < entry.author.size(); i++) {
+                authors << qMakePair(entry.author.at(i), entry);
+            }
+            for (int i = 0; i < entry.series.size(); i++) {
+                series << qMakePair(entry.series.at(i), entry);
+            }
+            publishers << qMakePair(entry.publisher, entry);
+            QUrl url(entry.filename.left(entry.filename.lastIndexOf("/")));
+            folders << qMakePair(url.path().mid(1), entry);
+            for (int i = 0; i < entry.genres.size(); i++) {
+                keywords << qMakePair(QString("Genre/").append(entry.genres.at(i)), entry);
+            }
+            for (int i = 0; i < entry.characters.size(); i++) {
+                keywords << qMakePair(QString("Characters/").append(entry.characters.at(i)), entry);
+            }
+            for (int i = 0; i < entry.keywords.size(); i++) {
+                keywords << qMakePair(QString("Keywords/").append(entry.keywords.at(i)), entry);
+            }
         }
+
+        entries.append(newEntries);
+        q->appendEntries(newEntries);
+        titleCategoryModel->addCategoryEntries(titles);
+        authorCategoryModel->addCategoryEntries(authors);
+        seriesCategoryModel->addCategoryEntries(series, SeriesRole);
+        newlyAddedCategoryModel->appendEntries(newEntries, CreatedRole);
+        publisherCategoryModel->addCategoryEntries(publishers);
+        folderCategoryModel->addCategoryEntries(folders);
+        folderCategoryModel->appendEntries(newEntries);
+        keywordCategoryModel->addCategoryEntries(keywords, GenreRole);
     }
 
-    void loadCache(BookListModel *q)
+    void loadCacheChunk(BookListModel *q, const QList<BookEntry> &entries)
     {
-        const QList<BookEntry> entries = db->loadEntries();
         if (entries.count() > 0) {
             initializeSubModels(q);
         }
-        int i = 0;
-        for (const BookEntry &entry : entries) {
-            /*
-             * This might turn out a little slow, but we should avoid having entries
-             * that do not exist. If we end up with slowdown issues when loading the
-             * cache this would be a good place to start investigating.
-             */
-            if (QFileInfo::exists(entry.filename)) {
-                addEntry(q, entry);
-                if (++i % 100 == 0) {
-                    emit q->countChanged();
-                    qApp->processEvents();
-                }
+        // Whether these all still exist gets checked by the database once it has passed them all on,
+        // so the shelves can be shown as quickly as at all possible
+        addEntries(q, entries);
+        emit q->countChanged();
+    }
+
+    QList<BookEntry> removeEntries(BookListModel *q, const QStringList &fileNames)
+    {
+        QList<BookEntry> removedEntries;
+        const QSet<QString> removed(fileNames.constBegin(), fileNames.constEnd());
+        QList<BookEntry>::iterator it = entries.begin();
+        while (it != entries.end()) {
+            if (removed.contains(it->filename)) {
+                emit q->entryRemoved(*it);
+                removedEntries << *it;
+                files.remove(it->filename);
+                it = entries.erase(it);
             } else {
-                db->removeEntry(entry);
+                ++it;
             }
         }
-        cacheLoaded = true;
-        emit q->cacheLoadedChanged();
+        emit q->countChanged();
+        return removedEntries;
     }
 };
 
@@ -236,6 +210,8 @@ BookListModel::BookListModel(QObject *parent)
     : CategoryEntriesModel(parent)
     , d(new Private)
 {
+    connect(d->ingester, &BookMetadataIngester::entriesReady, this, &BookListModel::ingestedEntriesReady);
+    connect(d->ingester, &BookMetadataIngester::progressChanged, this, &BookListModel::ingestionProgressChanged);
 }
 
 BookListModel::~BookListModel()
@@ -245,9 +221,17 @@ BookListModel::~BookListModel()
 
 void BookListModel::componentComplete()
 {
-    QTimer::singleShot(0, this, [this]() {
-        d->loadCache(this);
+    connect(d->db, &BookDatabase::entriesLoaded, this, [this](const QList<BookEntry> &entries) {
+        d->loadCacheChunk(this, entries);
+    });
+    connect(d->db, &BookDatabase::entriesLoadingFinished, this, [this]() {
+        d->cacheLoaded = true;
+        emit cacheLoadedChanged();
     });
+    connect(d->db, &BookDatabase::entriesMissing, this, [this](const QStringList &fileNames) {
+        d->removeEntries(this, fileNames);
+    });
+    d->db->loadEntries();
 }
 
 bool BookListModel::cacheLoaded() const
@@ -263,6 +247,7 @@ void BookListModel::setContentModel(QObject *newModel)
     d->contentModel = qobject_cast<QAbstractListModel *>(newModel);
     if (d->contentModel) {
         connect(d->contentModel, &QAbstractItemModel::rowsInserted, this, &BookListModel::contentModelItemsInserted);
+        connect(d->contentModel, &QAbstractItemModel::rowsAboutToBeRemoved, this, &BookListModel::contentModelItemsAboutToBeRemoved);
     }
     emit contentModelChanged();
 }
@@ -274,131 +259,67 @@ QObject *BookListModel::contentModel() const
 
 void BookListModel::contentModelItemsInserted(QModelIndex index, int first, int last)
 {
-    d->initializeSubModels(this);
-    int newRow = d->entries.count();
-    beginInsertRows(QModelIndex(), newRow, newRow + (last - first));
-    int role = d->contentModel->roleNames().key("filePath");
+    // Only pick up the data the content model holds here, the expensive metadata
+    // extraction happens on the ingester's worker threads
+    QList<QPair<QString, QVariantHash>> files;
+    const QHash<int, QByteArray> roleNames = d->contentModel->roleNames();
+    const int role = roleNames.key("filePath");
+    const int metadataRole = roleNames.key("metadata");
+    files.reserve(last - first + 1);
     for (int i = first; i < last + 1; ++i) {
-        QVariant filePath = d->contentModel->data(d->contentModel->index(first, 0, index), role);
-        BookEntry entry;
-        entry.filename = filePath.toUrl().toLocalFile();
-        QStringList splitName = entry.filename.split("/");
-        if (!splitName.isEmpty())
-            entry.filetitle = splitName.takeLast();
-        if (!splitName.isEmpty()) {
-            entry.series = QStringList(splitName.takeLast()); // hahahaheuristics (dumb assumptions about filesystems, go!)
-            entry.seriesNumbers = QStringList("0");
-            entry.seriesVolumes = QStringList("0");
+        const QModelIndex contentIndex = d->contentModel->index(i, 0, index);
+        QVariant filePath = d->contentModel->data(contentIndex, role);
+        const QVariantMap metadataMap = d->contentModel->data(contentIndex, metadataRole).toMap();
+        QVariantHash metadata;
+        for (auto it = metadataMap.constBegin(); it != metadataMap.constEnd(); ++it) {
+            metadata.insert(it.key(), it.value());
         }
-        // just in case we end up without a title... using complete basename here,
-        // as we would rather have "book one. part two" and the odd "book one - part two.tar"
-        QFileInfo fileinfo(entry.filename);
-        entry.title = fileinfo.completeBaseName();
+        files << qMakePair(filePath.toUrl().toLocalFile(), metadata);
+    }
+    d->ingester->addFiles(files);
+}
 
-        if (entry.filename.toLower().endsWith("cbr") || entry.filename.toLower().endsWith("cbz")) {
-            entry.thumbnail = QString("image://comiccover/").append(entry.filename);
-        }
-#ifdef USE_PERUSE_PDFTHUMBNAILER
-        else if (entry.filename.toLower().endsWith("pdf")) {
-            entry.thumbnail = QString("image://pdfcover/").append(entry.filename);
-        }
-#endif
-        else {
-            entry.thumbnail = QString("image://preview/").append(entry.filename);
-        }
+void BookListModel::contentModelItemsAboutToBeRemoved(QModelIndex index, int first, int last)
+{
+    // The content model only removes files which have gone away from the disk
+    QStringList fileNames;
+    int role = d->contentModel->roleNames().key("filePath");
+    for (int i = first; i < last + 1; ++i) {
+        const QModelIndex contentIndex = d->contentModel->index(i, 0, index);
+        fileNames << d->contentModel->data(contentIndex, role).toUrl().toLocalFile();
+    }
+    const QList<BookEntry> removed = d->removeEntries(this, fileNames);
+    if (!removed.isEmpty()) {
+        d->db->removeEntries(removed);
+    }
+}
 
-        KFileMetaData::UserMetaData data(entry.filename);
-        entry.rating = data.rating();
-        entry.comment = data.userComment();
-        entry.tags = data.tags();
-
-        QVariantHash metadata = d->contentModel->data(d->contentModel->index(first, 0, index), Qt::UserRole + 2).toHash();
-        QVariantHash::const_iterator it = metadata.constBegin();
-        for (; it != metadata.constEnd(); it++) {
-            if (it.key() == QLatin1String("author")) {
-                entry.author = it.value().toStringList();
-            } else if (it.key() == QLatin1String("title")) {
-                entry.title = it.value().toString().trimmed();
-            } else if (it.key() == QLatin1String("publisher")) {
-                entry.publisher = it.value().toString().trimmed();
-            } else if (it.key() == QLatin1String("created")) {
-                entry.created = it.value().toDateTime();
-            } else if (it.key() == QLatin1String("currentPage")) {
-                entry.currentPage = it.value().toInt();
-            } else if (it.key() == QLatin1String("totalPages")) {
-                entry.totalPages = it.value().toInt();
-            } else if (it.key() == QLatin1String("comments")) {
-                entry.comment = it.value().toString();
-            } else if (it.key() == QLatin1String("tags")) {
-                entry.tags = it.value().toStringList();
-            } else if (it.key() == QLatin1String("rating")) {
-                entry.rating = it.value().toInt();
-            }
-        }
-        // ACBF information is always preferred for CBRs, so let's just use that if it's there
-        QMimeDatabase db;
-        QString mimetype = db.mimeTypeForFile(entry.filename).name();
-        if (mimetype == "application/x-cbz" || mimetype == "application/x-cbr" || mimetype == "application/vnd.comicbook+zip"
-            || mimetype == "application/vnd.comicbook+rar") {
-            ArchiveBookModel *bookModel = new ArchiveBookModel(this);
-            bookModel->setFilename(entry.filename);
-
-            AdvancedComicBookFormat::Document *acbfDocument = qobject_cast<AdvancedComicBookFormat::Document *>(bookModel->acbfData());
-            if (acbfDocument) {
-                for (AdvancedComicBookFormat::Sequence *sequence : acbfDocument->metaData()->bookInfo()->sequence()) {
-                    if (!entry.series.contains(sequence->title())) {
-                        entry.series.append(sequence->title());
-                        entry.seriesNumbers.append(QString::number(sequence->number()));
-                        entry.seriesVolumes.append(QString::number(sequence->volume()));
-                    } else {
-                        int series = entry.series.indexOf(sequence->title());
-                        entry.seriesNumbers.replace(series, QString::number(sequence->number()));
-                        entry.seriesVolumes.replace(series, QString::number(sequence->volume()));
-                    }
-                }
-                for (AdvancedComicBookFormat::Author *author : acbfDocument->metaData()->bookInfo()->author()) {
-                    entry.author.append(author->displayName());
-                }
-                entry.description = acbfDocument->metaData()->bookInfo()->annotation("");
-                entry.genres = acbfDocument->metaData()->bookInfo()->genres();
-                entry.characters = acbfDocument->metaData()->bookInfo()->characters();
-                entry.keywords = acbfDocument->metaData()->bookInfo()->keywords("");
-            }
+void BookListModel::ingestedEntriesReady(const QList<BookEntry> &entries)
+{
+    d->initializeSubModels(this);
+    d->addEntries(this, entries);
+    d->db->addEntries(entries);
+    emit countChanged();
+}
 
-            if (entry.author.isEmpty()) {
-                entry.author.append(bookModel->author());
-            }
-            entry.title = bookModel->title();
-            entry.publisher = bookModel->publisher();
-            entry.totalPages = bookModel->pageCount();
-            bookModel->deleteLater();
-        } else {
-            static QMimeDatabase mimeDb;
-            static KFileMetaData::ExtractorCollection extractorCollection;
-
-            auto mimeType = mimeDb.mimeTypeForFile(entry.filename);
-
-            const auto extractors = extractorCollection.fetchExtractors(mimeType.name());
-
-            if (!extractors.isEmpty()) {
-                const auto &extractor = extractors.at(0);
-                PeruseExtractionResult result(entry.filename, mimeType.name());
-                extractor->extract(&result);
-
-                entry.author = result.authors;
-                entry.publisher = result.publishers.join(u", "_s);
-                entry.genres = result.genres;
-                // metadata["comments"_L1] = result.description;
-                entry.created = result.creation;
-            }
-        }
+bool BookListModel::ingesting() const
+{
+    return d->ingester->isRunning();
+}
 
-        d->addEntry(this, entry);
-        d->db->addEntry(entry);
-    }
-    endInsertRows();
-    emit countChanged();
-    qApp->processEvents();
+int BookListModel::ingestedCount() const
+{
+    return d->ingester->processedCount();
+}
+
+int BookListModel::ingestionTotal() const
+{
+    return d->ingester->totalCount();
+}
+
+void BookListModel::cancelIngestion()
+{
+    d->ingester->cancel();
 }
 
 QObject *BookListModel::titleCategoryModel() const
@@ -88,6 +88,18 @@ class BookListModel : public CategoryEntriesModel, public QQmlParserStatus
      * \brief cacheLoaded holds whether the database cache has been loaded..
      */
     Q_PROPERTY(bool cacheLoaded READ cacheLoaded NOTIFY cacheLoadedChanged)
+    /**
+     * \brief Whether newly found books are currently having their metadata read.
+     */
+    Q_PROPERTY(bool ingesting READ ingesting NOTIFY ingestionProgressChanged)
+    /**
+     * \brief How many of the newly found books have had their metadata read.
+     */
+    Q_PROPERTY(int ingestedCount READ ingestedCount NOTIFY ingestionProgressChanged)
+    /**
+     * \brief How many newly found books are being added to the catalogue in total.
+     */
+    Q_PROPERTY(int ingestionTotal READ ingestionTotal NOTIFY ingestionProgressChanged)
     Q_ENUMS(Grouping)
     Q_INTERFACES(QQmlParserStatus)
 public:
@@ -218,6 +230,29 @@ public:
      */
     Q_SIGNAL void cacheLoadedChanged();
 
+    /**
+     * @returns whether newly found books are currently having their metadata read.
+     */
+    bool ingesting() const;
+    /**
+     * @returns how many of the newly found books have had their metadata read.
+     */
+    int ingestedCount() const;
+    /**
+     * @returns how many newly found books are being added to the catalogue in total.
+     */
+    int ingestionTotal() const;
+    /**
+     * \brief Fires when the ingestion of newly found books progresses, starts or stops.
+     */
+    Q_SIGNAL void ingestionProgressChanged();
+    /**
+     * \brief Stop reading the metadata of newly found books.
+     *
+     * Books which have not yet been read will not be added to the catalogue.
+     */
+    Q_INVOKABLE void cancelIngestion();
+
     /**
      * \brief Update the data of a book at runtime
      *
@@ -248,6 +283,8 @@ private:
     Private *d;
 
     Q_SLOT void contentModelItemsInserted(QModelIndex index, int first, int last);
+    Q_SLOT void contentModelItemsAboutToBeRemoved(QModelIndex index, int first, int last);
+    Q_SLOT void ingestedEntriesReady(const QList<BookEntry> &entries);
 };
 
 #endif // BOOKLISTMODEL_H
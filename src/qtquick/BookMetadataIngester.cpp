@@ -0,0 +1,421 @@
+// SPDX-FileCopyrightText: 2026 Peruse contributors
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "BookMetadataIngester.h"
+
+#include "ArchiveBookModel.h"
+
+#include "AcbfAuthor.h"
+#include "AcbfBookinfo.h"
+#include "AcbfDocument.h"
+#include "AcbfSequence.h"
+
+#include <KFileMetaData/ExtractionResult>
+#include <KFileMetaData/ExtractorCollection>
+#include <KFileMetaData/Properties>
+#include <KFileMetaData/PropertyInfo>
+#include <KFileMetaData/UserMetaData>
+
+#include <QFileInfo>
+#include <QMimeDatabase>
+#include <QMutex>
+#include <QThread>
+#include <QThreadPool>
+#include <QTimer>
+
+#include <qtquick_debug.h>
+
+using namespace Qt::StringLiterals;
+
+namespace
+{
+QMutex userMetadataMutex;
+QHash<QString, QVariantHash> userMetadataCache;
+
+QVariantHash readUserMetadata(const QString &fileName)
+{
+    QVariantHash metadata;
+    KFileMetaData::UserMetaData data(fileName);
+    // Most books have no attributes at all, so find out which are there with a single
+    // listing, rather than asking for each of them in turn
+    const KFileMetaData::UserMetaData::Attributes present = data.queryAttributes(KFileMetaData::UserMetaData::All);
+    if (present == KFileMetaData::UserMetaData::None) {
+        return metadata;
+    }
+    if (present & KFileMetaData::UserMetaData::Other) {
+        if (data.hasAttribute(u"peruse.currentPage"_s)) {
+            metadata[u"currentPage"_s] = data.attribute(u"peruse.currentPage"_s).toInt();
+        }
+        if (data.hasAttribute(u"peruse.totalPages"_s)) {
+            metadata[u"totalPages"_s] = data.attribute(u"peruse.totalPages"_s).toInt();
+        }
+    }
+    if (present & KFileMetaData::UserMetaData::Tags) {
+        metadata[u"tags"_s] = data.tags();
+    }
+    if (present & KFileMetaData::UserMetaData::Comment) {
+        metadata[u"comments"_s] = data.userComment();
+    }
+    if (present & KFileMetaData::UserMetaData::Rating) {
+        metadata[u"rating"_s] = data.rating();
+    }
+    return metadata;
+}
+}
+
+class PeruseExtractionResult : public KFileMetaData::ExtractionResult
+{
+public:
+    PeruseExtractionResult(const QString &url, const QString &mimetype)
+        : KFileMetaData::ExtractionResult(url, mimetype, KFileMetaData::ExtractionResult::ExtractMetaData)
+    {
+    }
+
+    void add(KFileMetaData::Property::Property property, const QVariant &value) override
+    {
+        if (property == KFileMetaData::Property::Author) {
+            authors.append(value.toString());
+        }
+
+        if (property == KFileMetaData::Property::Publisher) {
+            publishers.append(value.toString());
+        }
+
+        if (property == KFileMetaData::Property::Subject) {
+            genres.append(value.toString());
+        }
+
+        if (property == KFileMetaData::Property::Description) {
+            description = value.toString();
+        }
+
+        if (property == KFileMetaData::Property::CreationDate) {
+            creation = value.toDateTime();
+        }
+    }
+
+    void addType(KFileMetaData::Type::Type type) override
+    {
+    }
+
+    void append(const QString &text) override
+    {
+    }
+
+    QStringList authors;
+    QStringList publishers;
+    QStringList genres;
+    QString description;
+    QDateTime creation;
+};
+
+class BookMetadataIngester::Private
+{
+public:
+    Private(BookMetadataIngester *qq)
+        : q(qq)
+    {
+        pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
+        flushTimer.setInterval(100);
+        QObject::connect(&flushTimer, &QTimer::timeout, q, [this]() {
+            flush();
+        });
+    }
+    BookMetadataIngester *q;
+    QThreadPool pool;
+    QTimer flushTimer;
+
+    mutable QMutex mutex;
+    // Incremented on cancellation, so work started before then knows to throw away its results
+    int generation{0};
+    QList<BookEntry> pending;
+    int processed{0};
+    int total{0};
+
+    bool isCurrent(int entryGeneration) const
+    {
+        QMutexLocker locker(&mutex);
+        return entryGeneration == generation;
+    }
+
+    void finishEntry(int entryGeneration, const BookEntry &entry)
+    {
+        QMutexLocker locker(&mutex);
+        if (entryGeneration == generation) {
+            pending << entry;
+            ++processed;
+        }
+    }
+
+    /**
+     * Hand the entries completed since the last flush over to the listeners, and stop
+     * once everything has been processed. Batching like this means the gui thread gets
+     * a single, larger chunk of entries to work on every so often, rather than being
+     * interrupted for every single book.
+     */
+    void flush()
+    {
+        QList<BookEntry> entries;
+        bool done = false;
+        {
+            QMutexLocker locker(&mutex);
+            entries.swap(pending);
+            if (processed >= total) {
+                done = true;
+                processed = 0;
+                total = 0;
+            }
+        }
+        if (done) {
+            flushTimer.stop();
+        }
+        if (!entries.isEmpty()) {
+            Q_EMIT q->entriesReady(entries);
+        }
+        Q_EMIT q->progressChanged();
+    }
+};
+
+BookMetadataIngester::BookMetadataIngester(QObject *parent)
+    : QObject(parent)
+    , d(new Private(this))
+{
+}
+
+BookMetadataIngester::~BookMetadataIngester()
+{
+    cancel();
+    d->pool.waitForDone();
+    delete d;
+}
+
+void BookMetadataIngester::addFiles(const QList<QPair<QString, QVariantHash>> &files)
+{
+    if (files.isEmpty()) {
+        return;
+    }
+    int generation;
+    {
+        QMutexLocker locker(&d->mutex);
+        d->total += files.count();
+        generation = d->generation;
+    }
+    // The extended attributes are read a directory at a time, which on network filesystems
+    // keeps the requests for them together, and then the books themselves spread out again
+    QHash<QString, QList<QPair<QString, QVariantHash>>> byDirectory;
+    for (const QPair<QString, QVariantHash> &file : files) {
+        byDirectory[file.first.left(file.first.lastIndexOf(QLatin1Char('/')))] << file;
+    }
+    for (const QList<QPair<QString, QVariantHash>> &directoryFiles : std::as_const(byDirectory)) {
+        d->pool.start([this, generation, directoryFiles]() {
+            if (!d->isCurrent(generation)) {
+                return;
+            }
+            QStringList fileNames;
+            fileNames.reserve(directoryFiles.count());
+            for (const QPair<QString, QVariantHash> &file : directoryFiles) {
+                fileNames << file.first;
+            }
+            loadUserMetadata(fileNames);
+            for (const QPair<QString, QVariantHash> &file : directoryFiles) {
+                d->pool.start([this, generation, file]() {
+                    if (!d->isCurrent(generation)) {
+                        return;
+                    }
+                    d->finishEntry(generation, entryForFile(file.first, file.second));
+                });
+            }
+        });
+    }
+    if (!d->flushTimer.isActive()) {
+        d->flushTimer.start();
+    }
+    Q_EMIT progressChanged();
+}
+
+void BookMetadataIngester::cancel()
+{
+    d->pool.clear();
+    {
+        QMutexLocker locker(&d->mutex);
+        ++d->generation;
+        d->pending.clear();
+        d->processed = 0;
+        d->total = 0;
+    }
+    d->flushTimer.stop();
+    Q_EMIT progressChanged();
+}
+
+bool BookMetadataIngester::isRunning() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->total > 0;
+}
+
+int BookMetadataIngester::processedCount() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->processed;
+}
+
+int BookMetadataIngester::totalCount() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->total;
+}
+
+BookEntry BookMetadataIngester::entryForFile(const QString &fileName, const QVariantHash &knownMetadata)
+{
+    BookEntry entry;
+    entry.filename = fileName;
+    QStringList splitName = entry.filename.split("/");
+    if (!splitName.isEmpty())
+        entry.filetitle = splitName.takeLast();
+    if (!splitName.isEmpty()) {
+        entry.series = QStringList(splitName.takeLast()); // hahahaheuristics (dumb assumptions about filesystems, go!)
+        entry.seriesNumbers = QStringList("0");
+        entry.seriesVolumes = QStringList("0");
+    }
+    // just in case we end up without a title... using complete basename here,
+    // as we would rather have "book one. part two" and the odd "book one - part two.tar"
+    QFileInfo fileinfo(entry.filename);
+    entry.title = fileinfo.completeBaseName();
+
+    if (entry.filename.toLower().endsWith("cbr") || entry.filename.toLower().endsWith("cbz")) {
+        entry.thumbnail = QString("image://comiccover/").append(entry.filename);
+    }
+#ifdef USE_PERUSE_PDFTHUMBNAILER
+    else if (entry.filename.toLower().endsWith("pdf")) {
+        entry.thumbnail = QString("image://pdfcover/").append(entry.filename);
+    }
+#endif
+    else {
+        entry.thumbnail = QString("image://preview/").append(entry.filename);
+    }
+
+    // What was passed in is preferred over what is stored in the file's attributes
+    QVariantHash metadata = userMetadataForFile(entry.filename);
+    metadata.insert(knownMetadata);
+
+    QVariantHash::const_iterator it = metadata.constBegin();
+    for (; it != metadata.constEnd(); it++) {
+        if (it.key() == QLatin1String("author")) {
+            entry.author = it.value().toStringList();
+        } else if (it.key() == QLatin1String("title")) {
+            entry.title = it.value().toString().trimmed();
+        } else if (it.key() == QLatin1String("publisher")) {
+            entry.publisher = it.value().toString().trimmed();
+        } else if (it.key() == QLatin1String("created")) {
+            entry.created = it.value().toDateTime();
+        } else if (it.key() == QLatin1String("currentPage")) {
+            entry.currentPage = it.value().toInt();
+        } else if (it.key() == QLatin1String("totalPages")) {
+            entry.totalPages = it.value().toInt();
+        } else if (it.key() == QLatin1String("comments")) {
+            entry.comment = it.value().toString();
+        } else if (it.key() == QLatin1String("tags")) {
+            entry.tags = it.value().toStringList();
+        } else if (it.key() == QLatin1String("rating")) {
+            entry.rating = it.value().toInt();
+        }
+    }
+
+    // ACBF information is always preferred for CBRs, so let's just use that if it's there
+    static QMimeDatabase mimeDb;
+    QString mimetype = mimeDb.mimeTypeForFile(entry.filename).name();
+    if (mimetype == "application/x-cbz" || mimetype == "application/x-cbr" || mimetype == "application/vnd.comicbook+zip"
+        || mimetype == "application/vnd.comicbook+rar") {
+        ArchiveBookModel bookModel;
+        bookModel.setMetadataOnly(true);
+        bookModel.setFilename(entry.filename);
+
+        AdvancedComicBookFormat::Document *acbfDocument = qobject_cast<AdvancedComicBookFormat::Document *>(bookModel.acbfData());
+        if (acbfDocument) {
+            for (AdvancedComicBookFormat::Sequence *sequence : acbfDocument->metaData()->bookInfo()->sequence()) {
+                if (!entry.series.contains(sequence->title())) {
+                    entry.series.append(sequence->title());
+                    entry.seriesNumbers.append(QString::number(sequence->number()));
+                    entry.seriesVolumes.append(QString::number(sequence->volume()));
+                } else {
+                    int series = entry.series.indexOf(sequence->title());
+                    entry.seriesNumbers.replace(series, QString::number(sequence->number()));
+                    entry.seriesVolumes.replace(series, QString::number(sequence->volume()));
+                }
+            }
+            for (AdvancedComicBookFormat::Author *author : acbfDocument->metaData()->bookInfo()->author()) {
+                entry.author.append(author->displayName());
+            }
+            entry.description = acbfDocument->metaData()->bookInfo()->annotation("");
+            entry.genres = acbfDocument->metaData()->bookInfo()->genres();
+            entry.characters = acbfDocument->metaData()->bookInfo()->characters();
+            entry.keywords = acbfDocument->metaData()->bookInfo()->keywords("");
+        }
+
+        if (entry.author.isEmpty()) {
+            entry.author.append(bookModel.author());
+        }
+        entry.title = bookModel.title();
+        entry.publisher = bookModel.publisher();
+        entry.totalPages = bookModel.pageCount();
+    } else {
+        // Extractors are not safe to share between threads, so each worker gets its own set
+        thread_local KFileMetaData::ExtractorCollection extractorCollection;
+
+        const auto extractors = extractorCollection.fetchExtractors(mimetype);
+
+        if (!extractors.isEmpty()) {
+            const auto &extractor = extractors.at(0);
+            PeruseExtractionResult result(entry.filename, mimetype);
+            extractor->extract(&result);
+
+            entry.author = result.authors;
+            entry.publisher = result.publishers.join(u", "_s);
+            entry.genres = result.genres;
+            // metadata["comments"_L1] = result.description;
+            entry.created = result.creation;
+        }
+    }
+
+    return entry;
+}
+
+QVariantHash BookMetadataIngester::userMetadataForFile(const QString &fileName)
+{
+    {
+        QMutexLocker locker(&userMetadataMutex);
+        const auto it = userMetadataCache.constFind(fileName);
+        if (it != userMetadataCache.constEnd()) {
+            return *it;
+        }
+    }
+    const QVariantHash metadata = readUserMetadata(fileName);
+    QMutexLocker locker(&userMetadataMutex);
+    userMetadataCache.insert(fileName, metadata);
+    return metadata;
+}
+
+void BookMetadataIngester::loadUserMetadata(const QStringList &fileNames)
+{
+    QStringList missing;
+    {
+        QMutexLocker locker(&userMetadataMutex);
+        for (const QString &fileName : fileNames) {
+            if (!userMetadataCache.contains(fileName)) {
+                missing << fileName;
+            }
+        }
+    }
+    QHash<QString, QVariantHash> loaded;
+    for (const QString &fileName : std::as_const(missing)) {
+        loaded.insert(fileName, readUserMetadata(fileName));
+    }
+    QMutexLocker locker(&userMetadataMutex);
+    userMetadataCache.insert(loaded);
+}
+
+void BookMetadataIngester::forgetUserMetadata(const QString &fileName)
+{
+    QMutexLocker locker(&userMetadataMutex);
+    userMetadataCache.remove(fileName);
+}
@@ -0,0 +1,115 @@
+// SPDX-FileCopyrightText: 2026 Peruse contributors
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#ifndef BOOKMETADATAINGESTER_H
+#define BOOKMETADATAINGESTER_H
+
+#include <QObject>
+#include <QVariantHash>
+
+#include "CategoryEntriesModel.h"
+
+/**
+ * \brief Extracts the metadata for newly found books on a pool of worker threads
+ *
+ * Reading the metadata of a book can be expensive (for comic book archives it means
+ * opening the archive and parsing the ACBF, ComicInfo or CoMet documents inside it),
+ * so the ingester spreads this work out across the available cores, and hands the
+ * finished entries back in batches through entriesReady().
+ *
+ * The ingester should be used from the thread it lives in, and all signals are
+ * emitted on that thread.
+ */
+class BookMetadataIngester : public QObject
+{
+    Q_OBJECT
+public:
+    explicit BookMetadataIngester(QObject *parent = nullptr);
+    ~BookMetadataIngester() override;
+
+    /**
+     * \brief Queue up files for metadata extraction
+     *
+     * @param files A list of pairs of local filenames, and any metadata already known about
+     * that file (such as that found by the content lister). Known metadata is preferred over
+     * what can be found in the file itself, with the exception of ACBF data.
+     */
+    void addFiles(const QList<QPair<QString, QVariantHash>> &files);
+
+    /**
+     * \brief Stop all work which has not yet completed
+     *
+     * Entries which are currently being extracted will be discarded once done,
+     * and entriesReady() will not be emitted again until new files are added.
+     */
+    void cancel();
+
+    /**
+     * @return True if there are files waiting for, or undergoing, metadata extraction
+     */
+    bool isRunning() const;
+    /**
+     * @return The number of files which have been processed since the ingester was last idle
+     */
+    int processedCount() const;
+    /**
+     * @return The number of files queued up since the ingester was last idle
+     */
+    int totalCount() const;
+
+    /**
+     * \brief Fired with a batch of entries with their metadata filled in
+     * @param entries The completed entries
+     */
+    Q_SIGNAL void entriesReady(const QList<BookEntry> &entries);
+    /**
+     * \brief Fired whenever the running state, processed or total count changes
+     */
+    Q_SIGNAL void progressChanged();
+
+    /**
+     * \brief Construct an entry for the given file, reading its metadata
+     *
+     * This is what the worker threads do for each file, and is safe to call
+     * from any thread.
+     *
+     * @param fileName The local filename of the book
+     * @param knownMetadata Metadata already known about the file
+     * @return A book entry with as much information filled in as could be found
+     */
+    static BookEntry entryForFile(const QString &fileName, const QVariantHash &knownMetadata);
+
+    /**
+     * \brief The metadata the user has stored for the file in its extended attributes
+     *
+     * This is the reading progress (currentPage and totalPages), tags, comments and rating,
+     * using the same keys as for the known metadata passed to entryForFile(). The attributes
+     * are read once per session and then cached, as on network filesystems every attribute
+     * read is a round trip to the server.
+     *
+     * @param fileName The local filename of the book
+     * @return The metadata found, holding only the keys the file had attributes for
+     */
+    static QVariantHash userMetadataForFile(const QString &fileName);
+    /**
+     * \brief Read the extended attributes for a set of files into the cache in one go
+     *
+     * This is what the ingester does for each directory worth of files it is given.
+     * @param fileNames The local filenames of the books, ideally all in the same directory
+     */
+    static void loadUserMetadata(const QStringList &fileNames);
+    /**
+     * \brief Drop the cached extended attributes for a file
+     *
+     * Call this after changing the attributes of a file, so they are read again
+     * the next time they are needed.
+     * @param fileName The local filename of the book
+     */
+    static void forgetUserMetadata(const QString &fileName);
+
+private:
+    class Private;
+    Private *d;
+};
+
+#endif // BOOKMETADATAINGESTER_H
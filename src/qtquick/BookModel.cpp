@@ -20,6 +20,7 @@
  */
 
 #include "BookModel.h"
+#include "BookMetadataIngester.h"
 #include "qtquick_debug.h"
 
 #include <AcbfDocument.h>
@@ -192,6 +193,7 @@ void BookModel::setCurrentPage(int newCurrentPage, bool updateFilesystem)
     if (updateFilesystem) {
         KFileMetaData::UserMetaData data(d->filename);
         data.setAttribute("peruse.currentPage", QString::number(newCurrentPage));
+        BookMetadataIngester::forgetUserMetadata(d->filename);
     }
     d->currentPage = newCurrentPage;
     emit currentPageChanged();
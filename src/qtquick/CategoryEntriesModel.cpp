@@ -21,9 +21,14 @@
 
 #include "CategoryEntriesModel.h"
 
+#include <QCollator>
 #include <QDir>
 #include <QFileInfo>
 #include <QMimeDatabase>
+#include <QSet>
+
+#include <algorithm>
+#include <numeric>
 
 #include <KFileMetaData/UserMetaData>
 
@@ -37,6 +42,119 @@ public:
     QString name;
     QList<BookEntry> entries;
     QList<CategoryEntriesModel *> categoryModels;
+
+    /**
+     * Lookup structures, so adding a book to large trees does not require scanning through every
+     * entry and category at every level. The sort keys are kept in the same order as the entries
+     * and category models, and the file rows are rebuilt on demand after entries move around.
+     */
+    QList<QCollatorSortKey> titleKeys;
+    QList<QCollatorSortKey> categoryKeys;
+    QHash<QString, CategoryEntriesModel *> categoryModelsByName;
+    QSet<QString> files;
+    mutable QHash<QString, int> fileRows;
+    mutable bool fileRowsDirty{false};
+
+    // Shared between all the models, as there can be a great many of them (one per author, for example)
+    static QCollator &collator()
+    {
+        static QCollator collator;
+        return collator;
+    }
+
+    void insertEntry(int index, const BookEntry &entry)
+    {
+        entries.insert(index, entry);
+        titleKeys.insert(index, collator().sortKey(entry.title));
+        files.insert(entry.filename);
+        if (index == entries.count() - 1 && !fileRowsDirty) {
+            fileRows.insert(entry.filename, index);
+        } else {
+            fileRowsDirty = true;
+        }
+    }
+
+    void removeEntry(int index)
+    {
+        files.remove(entries.at(index).filename);
+        entries.removeAt(index);
+        titleKeys.removeAt(index);
+        fileRowsDirty = true;
+    }
+
+    void clearEntries()
+    {
+        entries.clear();
+        titleKeys.clear();
+        files.clear();
+        fileRows.clear();
+        fileRowsDirty = false;
+    }
+
+    /**
+     * The volume and number of the entry in the series this model represents, or zeroes if it has none
+     */
+    QPair<int, int> seriesPosition(const BookEntry &entry) const
+    {
+        int series = entry.series.indexOf(name);
+        if (series == -1) {
+            for (int s = 0; s < entry.series.size(); s++) {
+                if (QString::compare(name, entry.series.at(s), Qt::CaseInsensitive) == 0) {
+                    series = s;
+                    break;
+                }
+            }
+        }
+        if (series == -1) {
+            return qMakePair(0, 0);
+        }
+        return qMakePair(entry.seriesVolumes.value(series).toInt(), entry.seriesNumbers.value(series).toInt());
+    }
+
+    /**
+     * Whether the first entry goes before the second in the series this model represents. Entries are ordered
+     * by their volume and then number in the series, and entries without a number go after all those with one,
+     * ordered by title (using the given sort keys for the entries' titles).
+     */
+    bool seriesBefore(const BookEntry &one, const QCollatorSortKey &oneKey, const BookEntry &other, const QCollatorSortKey &otherKey) const
+    {
+        const QPair<int, int> onePosition = seriesPosition(one);
+        const QPair<int, int> otherPosition = seriesPosition(other);
+        const bool oneNumbered = onePosition.second > 0;
+        const bool otherNumbered = otherPosition.second > 0;
+        if (oneNumbered != otherNumbered) {
+            return oneNumbered;
+        }
+        if (oneNumbered && onePosition != otherPosition) {
+            return onePosition < otherPosition;
+        }
+        return oneKey.compare(otherKey) < 0;
+    }
+
+    CategoryEntriesModel *createCategoryModel(const QString &categoryName)
+    {
+        CategoryEntriesModel *categoryModel = new CategoryEntriesModel(q);
+        connect(q, &CategoryEntriesModel::entryDataUpdated, categoryModel, &CategoryEntriesModel::entryDataUpdated);
+        connect(q, &CategoryEntriesModel::entryRemoved, categoryModel, &CategoryEntriesModel::entryRemoved);
+        categoryModel->setName(categoryName);
+        return categoryModel;
+    }
+
+    int rowOfFile(const QString &filename) const
+    {
+        if (!files.contains(filename)) {
+            return -1;
+        }
+        if (fileRowsDirty) {
+            fileRows.clear();
+            fileRows.reserve(entries.count());
+            for (int i = 0; i < entries.count(); ++i) {
+                fileRows.insert(entries.at(i).filename, i);
+            }
+            fileRowsDirty = false;
+        }
+        return fileRows.value(filename, -1);
+    }
 };
 
 bool operator==(const BookEntry &b1, const BookEntry &b2) noexcept
@@ -181,54 +299,35 @@ void CategoryEntriesModel::append(const BookEntry &entry, Roles compareRole)
     if (compareRole == UnknownRole) {
         // If we don't know what order to sort by, literally just append the entry
         insertionIndex = d->entries.count();
+    } else if (compareRole == CreatedRole) {
+        // Newest first, and after any existing entries created at the same time
+        auto it = std::partition_point(d->entries.constBegin(), d->entries.constEnd(), [&entry](const BookEntry &existing) {
+            return entry.created <= existing.created;
+        });
+        insertionIndex = it - d->entries.constBegin();
+    } else if (compareRole != SeriesRole) {
+        // After any existing entries with the same title
+        const QCollatorSortKey key = Private::collator().sortKey(entry.title);
+        auto it = std::upper_bound(d->titleKeys.constBegin(), d->titleKeys.constEnd(), key, [](const QCollatorSortKey &one, const QCollatorSortKey &other) {
+            return one.compare(other) < 0;
+        });
+        insertionIndex = it - d->titleKeys.constBegin();
     } else {
-        int seriesOne = -1;
-        int seriesTwo = -1;
-        if (compareRole == SeriesRole) {
-            seriesOne = entry.series.indexOf(name());
-            if (entry.series.contains(name(), Qt::CaseInsensitive) && seriesOne == -1) {
-                for (int s = 0; s < entry.series.size(); s++) {
-                    if (QString::compare(name(), entry.series.at(s), Qt::CaseInsensitive)) {
-                        seriesOne = s;
-                    }
-                }
-            }
-        }
-        for (; insertionIndex < d->entries.count(); ++insertionIndex) {
-            if (compareRole == SeriesRole) {
-                seriesTwo = d->entries.at(insertionIndex).series.indexOf(name());
-                if (d->entries.at(insertionIndex).series.contains(name(), Qt::CaseInsensitive) && seriesTwo == -1) {
-                    for (int s = 0; s < d->entries.at(insertionIndex).series.size(); s++) {
-                        if (QString::compare(name(), d->entries.at(insertionIndex).series.at(s), Qt::CaseInsensitive)) {
-                            seriesTwo = s;
-                        }
-                    }
-                }
-            }
-            if (compareRole == CreatedRole) {
-                if (entry.created <= d->entries.at(insertionIndex).created) {
-                    continue;
-                }
-                break;
-            } else if ((seriesOne > -1 && seriesTwo > -1) && entry.seriesNumbers.count() > -1 && entry.seriesNumbers.count() > seriesOne
-                       && d->entries.at(insertionIndex).seriesNumbers.count() > -1 && d->entries.at(insertionIndex).seriesNumbers.count() > seriesTwo
-                       && entry.seriesNumbers.at(seriesOne).toInt() > 0 && d->entries.at(insertionIndex).seriesNumbers.at(seriesTwo).toInt() > 0) {
-                if (entry.seriesVolumes.count() > -1 && entry.seriesVolumes.count() > seriesOne && d->entries.at(insertionIndex).seriesVolumes.count() > -1
-                    && d->entries.at(insertionIndex).seriesVolumes.count() > seriesTwo
-                    && entry.seriesVolumes.at(seriesOne).toInt() >= d->entries.at(insertionIndex).seriesVolumes.at(seriesTwo).toInt()
-                    && entry.seriesNumbers.at(seriesOne).toInt() > d->entries.at(insertionIndex).seriesNumbers.at(seriesTwo).toInt()) {
-                    continue;
-                }
-                break;
+        // After any existing entries in the same place in the series
+        const QCollatorSortKey key = Private::collator().sortKey(entry.title);
+        int high = d->entries.count();
+        while (insertionIndex < high) {
+            const int middle = (insertionIndex + high) / 2;
+            if (d->seriesBefore(entry, key, d->entries.at(middle), d->titleKeys.at(middle))) {
+                high = middle;
             } else {
-                if (QString::localeAwareCompare(d->entries.at(insertionIndex).title, entry.title) > 0) {
-                    break;
-                }
+                insertionIndex = middle + 1;
             }
         }
     }
-    beginInsertRows(QModelIndex(), insertionIndex, insertionIndex);
-    d->entries.insert(insertionIndex, entry);
+    const int row = d->categoryModels.count() + insertionIndex;
+    beginInsertRows(QModelIndex(), row, row);
+    d->insertEntry(insertionIndex, entry);
     Q_EMIT countChanged();
     endInsertRows();
 }
@@ -241,7 +340,7 @@ void CategoryEntriesModel::appendFakeBook(const BookEntry &book, CategoryEntries
 void CategoryEntriesModel::clear()
 {
     beginResetModel();
-    d->entries.clear();
+    d->clearEntries();
     endResetModel();
 }
 
@@ -259,7 +358,7 @@ CategoryEntriesModel *CategoryEntriesModel::leafModelForEntry(const BookEntry &e
 {
     CategoryEntriesModel *model(nullptr);
     if (d->categoryModels.count() == 0) {
-        if (d->entries.contains(entry)) {
+        if (d->files.contains(entry.filename)) {
             model = this;
         }
     } else {
@@ -282,27 +381,20 @@ void CategoryEntriesModel::addCategoryEntry(const QString &categoryName, const B
         if (splitPos > -1) {
             desiredCategory = categoryName.left(splitPos);
         }
-        CategoryEntriesModel *categoryModel = nullptr;
-        for (CategoryEntriesModel *existingModel : std::as_const(d->categoryModels)) {
-            if (QString::compare(existingModel->name(), desiredCategory, Qt::CaseInsensitive) == 0) {
-                categoryModel = existingModel;
-                break;
-            }
-        }
+        const QString categoryKey = desiredCategory.toCaseFolded();
+        CategoryEntriesModel *categoryModel = d->categoryModelsByName.value(categoryKey);
         if (!categoryModel) {
-            categoryModel = new CategoryEntriesModel(this);
-            connect(this, &CategoryEntriesModel::entryDataUpdated, categoryModel, &CategoryEntriesModel::entryDataUpdated);
-            connect(this, &CategoryEntriesModel::entryRemoved, categoryModel, &CategoryEntriesModel::entryRemoved);
-            categoryModel->setName(desiredCategory);
-
-            int insertionIndex = 0;
-            for (; insertionIndex < d->categoryModels.count(); ++insertionIndex) {
-                if (QString::localeAwareCompare(d->categoryModels.at(insertionIndex)->name(), categoryModel->name()) > 0) {
-                    break;
-                }
-            }
+            categoryModel = d->createCategoryModel(desiredCategory);
+
+            const QCollatorSortKey key = Private::collator().sortKey(categoryModel->name());
+            auto it = std::upper_bound(d->categoryKeys.constBegin(), d->categoryKeys.constEnd(), key, [](const QCollatorSortKey &one, const QCollatorSortKey &other) {
+                return one.compare(other) < 0;
+            });
+            const int insertionIndex = it - d->categoryKeys.constBegin();
             beginInsertRows(QModelIndex(), insertionIndex, insertionIndex);
             d->categoryModels.insert(insertionIndex, categoryModel);
+            d->categoryKeys.insert(insertionIndex, key);
+            d->categoryModelsByName.insert(categoryKey, categoryModel);
             endInsertRows();
         }
         if (categoryModel->indexOfFile(entry.filename) == -1) {
@@ -313,6 +405,183 @@ void CategoryEntriesModel::addCategoryEntry(const QString &categoryName, const B
     }
 }
 
+void CategoryEntriesModel::appendEntries(const QList<BookEntry> &entries, Roles compareRole)
+{
+    QList<BookEntry> newEntries;
+    QSet<QString> newFiles;
+    newEntries.reserve(entries.count());
+    for (const BookEntry &entry : entries) {
+        if (!d->files.contains(entry.filename) && !newFiles.contains(entry.filename)) {
+            newFiles.insert(entry.filename);
+            newEntries << entry;
+        }
+    }
+    if (newEntries.isEmpty()) {
+        return;
+    }
+
+    QList<QCollatorSortKey> newKeys;
+    newKeys.reserve(newEntries.count());
+    for (const BookEntry &entry : std::as_const(newEntries)) {
+        newKeys << Private::collator().sortKey(entry.title);
+    }
+    // Whether the first entry should go before the second, with entries which compare equal keeping their order
+    auto before = [this, compareRole](const BookEntry &one, const QCollatorSortKey &oneKey, const BookEntry &other, const QCollatorSortKey &otherKey) {
+        if (compareRole == UnknownRole) {
+            return false;
+        } else if (compareRole == CreatedRole) {
+            return one.created > other.created;
+        } else if (compareRole == SeriesRole) {
+            return d->seriesBefore(one, oneKey, other, otherKey);
+        }
+        return oneKey.compare(otherKey) < 0;
+    };
+    if (compareRole != UnknownRole) {
+        QList<int> order(newEntries.count());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](int one, int other) {
+            return before(newEntries.at(one), newKeys.at(one), newEntries.at(other), newKeys.at(other));
+        });
+        QList<BookEntry> sortedEntries;
+        QList<QCollatorSortKey> sortedKeys;
+        sortedEntries.reserve(order.count());
+        sortedKeys.reserve(order.count());
+        for (int index : std::as_const(order)) {
+            sortedEntries << newEntries.at(index);
+            sortedKeys << newKeys.at(index);
+        }
+        newEntries = sortedEntries;
+        newKeys = sortedKeys;
+    }
+
+    // Merge the sorted entries in, inserting each run of them which goes in between the same two existing
+    // entries as a single range, so views keep their place and delegates. Existing entries go first when
+    // equal, which matches how append() places entries.
+    int added = 0;
+    int existing = 0;
+    while (added < newEntries.count()) {
+        int low = existing;
+        int high = d->entries.count();
+        while (low < high) {
+            const int middle = (low + high) / 2;
+            if (before(newEntries.at(added), newKeys.at(added), d->entries.at(middle), d->titleKeys.at(middle))) {
+                high = middle;
+            } else {
+                low = middle + 1;
+            }
+        }
+        const int insertionIndex = low;
+        int runEnd = added + 1;
+        while (runEnd < newEntries.count()
+               && (insertionIndex == d->entries.count()
+                   || before(newEntries.at(runEnd), newKeys.at(runEnd), d->entries.at(insertionIndex), d->titleKeys.at(insertionIndex)))) {
+            ++runEnd;
+        }
+        const int runLength = runEnd - added;
+        const int first = d->categoryModels.count() + insertionIndex;
+        beginInsertRows(QModelIndex(), first, first + runLength - 1);
+        for (int i = 0; i < runLength; ++i) {
+            d->entries.insert(insertionIndex + i, newEntries.at(added + i));
+            d->titleKeys.insert(insertionIndex + i, newKeys.at(added + i));
+            d->files.insert(newEntries.at(added + i).filename);
+        }
+        d->fileRowsDirty = true;
+        endInsertRows();
+        existing = insertionIndex + runLength;
+        added = runEnd;
+    }
+    Q_EMIT countChanged();
+}
+
+void CategoryEntriesModel::addCategoryEntries(const QList<QPair<QString, BookEntry>> &entries, Roles compareRole)
+{
+    static const QString splitString{"/"};
+    // Group everything by the category at this level first, keeping the order of categories as found
+    QList<CategoryEntriesModel *> categoryModels;
+    QHash<CategoryEntriesModel *, QList<BookEntry>> categoryEntries;
+    QHash<CategoryEntriesModel *, QList<QPair<QString, BookEntry>>> subCategoryEntries;
+    QList<CategoryEntriesModel *> newModels;
+    QHash<QString, CategoryEntriesModel *> newModelsByName;
+    for (const QPair<QString, BookEntry> &entry : entries) {
+        const QString &categoryName = entry.first;
+        if (categoryName.isEmpty()) {
+            continue;
+        }
+        int splitPos = categoryName.indexOf(splitString);
+        QString desiredCategory{categoryName};
+        if (splitPos > -1) {
+            desiredCategory = categoryName.left(splitPos);
+        }
+        const QString categoryKey = desiredCategory.toCaseFolded();
+        CategoryEntriesModel *categoryModel = d->categoryModelsByName.value(categoryKey);
+        if (!categoryModel) {
+            categoryModel = newModelsByName.value(categoryKey);
+        }
+        if (!categoryModel) {
+            categoryModel = d->createCategoryModel(desiredCategory);
+            newModels << categoryModel;
+            newModelsByName.insert(categoryKey, categoryModel);
+        }
+        if (!categoryEntries.contains(categoryModel)) {
+            categoryModels << categoryModel;
+        }
+        categoryEntries[categoryModel] << entry.second;
+        if (splitPos > -1) {
+            subCategoryEntries[categoryModel] << qMakePair(categoryName.mid(splitPos + 1), entry.second);
+        }
+    }
+
+    if (!newModels.isEmpty()) {
+        QList<QCollatorSortKey> newKeys;
+        newKeys.reserve(newModels.count());
+        for (CategoryEntriesModel *model : std::as_const(newModels)) {
+            newKeys << Private::collator().sortKey(model->name());
+        }
+        QList<int> order(newModels.count());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&newKeys](int one, int other) {
+            return newKeys.at(one).compare(newKeys.at(other)) < 0;
+        });
+        // As with the entries, each run of new categories which goes between the same two existing ones is a single insertion
+        int added = 0;
+        int existing = 0;
+        while (added < order.count()) {
+            auto it = std::upper_bound(d->categoryKeys.constBegin() + existing,
+                                       d->categoryKeys.constEnd(),
+                                       newKeys.at(order.at(added)),
+                                       [](const QCollatorSortKey &one, const QCollatorSortKey &other) {
+                                           return one.compare(other) < 0;
+                                       });
+            const int insertionIndex = it - d->categoryKeys.constBegin();
+            int runEnd = added + 1;
+            while (runEnd < order.count()
+                   && (insertionIndex == d->categoryKeys.count() || newKeys.at(order.at(runEnd)).compare(d->categoryKeys.at(insertionIndex)) < 0)) {
+                ++runEnd;
+            }
+            const int runLength = runEnd - added;
+            beginInsertRows(QModelIndex(), insertionIndex, insertionIndex + runLength - 1);
+            for (int i = 0; i < runLength; ++i) {
+                CategoryEntriesModel *model = newModels.at(order.at(added + i));
+                d->categoryModels.insert(insertionIndex + i, model);
+                d->categoryKeys.insert(insertionIndex + i, newKeys.at(order.at(added + i)));
+                d->categoryModelsByName.insert(model->name().toCaseFolded(), model);
+            }
+            endInsertRows();
+            existing = insertionIndex + runLength;
+            added = runEnd;
+        }
+        Q_EMIT countChanged();
+    }
+
+    for (CategoryEntriesModel *categoryModel : std::as_const(categoryModels)) {
+        categoryModel->appendEntries(categoryEntries.value(categoryModel), compareRole);
+        const QList<QPair<QString, BookEntry>> subEntries = subCategoryEntries.value(categoryModel);
+        if (!subEntries.isEmpty()) {
+            categoryModel->addCategoryEntries(subEntries);
+        }
+    }
+}
+
 BookEntry CategoryEntriesModel::getBookEntry(int index) const
 {
     if (index > -1 && index < d->entries.count()) {
@@ -323,17 +592,7 @@ BookEntry CategoryEntriesModel::getBookEntry(int index) const
 
 int CategoryEntriesModel::indexOfFile(const QString &filename) const
 {
-    int index = -1, i = 0;
-    if (QFile::exists(filename)) {
-        for (const BookEntry &entry : d->entries) {
-            if (entry.filename == filename) {
-                index = i;
-                break;
-            }
-            ++i;
-        }
-    }
-    return index;
+    return d->rowOfFile(filename);
 }
 
 bool CategoryEntriesModel::indexIsBook(int index) const
@@ -407,18 +666,20 @@ BookEntry CategoryEntriesModel::bookFromFile(const QString &filename) const
 
 void CategoryEntriesModel::entryDataChanged(const BookEntry &entry)
 {
-    int entryIndex = d->entries.indexOf(entry) + d->categoryModels.count();
-    QModelIndex changed = index(entryIndex);
-    dataChanged(changed, changed);
+    int listIndex = d->rowOfFile(entry.filename);
+    if (listIndex > -1) {
+        QModelIndex changed = index(listIndex + d->categoryModels.count());
+        dataChanged(changed, changed);
+    }
 }
 
 void CategoryEntriesModel::entryRemove(const BookEntry &entry)
 {
-    int listIndex = d->entries.indexOf(entry);
+    int listIndex = d->rowOfFile(entry.filename);
     if (listIndex > -1) {
         int entryIndex = listIndex + d->categoryModels.count();
         beginRemoveRows(QModelIndex(), entryIndex, entryIndex);
-        d->entries.removeAll(entry);
+        d->removeEntry(listIndex);
         endRemoveRows();
     }
 }
@@ -203,6 +203,31 @@ public:
      */
     void addCategoryEntry(const QString &categoryName, const BookEntry &entry, Roles compareRole = TitleRole);
 
+    /**
+     * \brief Add a number of book entries to the model in one go.
+     *
+     * The entries are sorted once, and then merged in, with each run of entries which goes
+     * in between the same two existing entries added using a single range insertion.
+     * Entries which are already in the model are skipped.
+     *
+     * @param entries The BookEntries to add.
+     * @param compareRole The role that determines the data to sort the entries by.
+     * Defaults to the Book title.
+     */
+    void appendEntries(const QList<BookEntry> &entries, Roles compareRole = TitleRole);
+
+    /**
+     * \brief Add a number of book entries to categories in one go.
+     *
+     * This works like addCategoryEntry(), except that each category model, at any level,
+     * only gets one range insertion for each run of new categories which go in between the
+     * same two existing categories, and likewise for its new entries.
+     *
+     * @param entries A list of pairs of category names and the entry to add to that category.
+     * @param compareRole The role that determines the data to sort the entries by.
+     */
+    void addCategoryEntries(const QList<QPair<QString, BookEntry>> &entries, Roles compareRole = TitleRole);
+
     /**
      * @param index an integer index pointing at the desired book.
      * @returns the BookEntry struct for the given index (owned by this model, do not delete)
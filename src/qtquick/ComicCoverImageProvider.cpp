@@ -21,16 +21,21 @@
 
 #include "ComicCoverImageProvider.h"
 
-#include <KRar.h>
-#include <KZip>
-#include <karchive.h>
-#include <karchivefile.h>
+#include "ArchiveCoverReader.h"
+#include "CoverAtlas.h"
+#include "ThumbnailScheduler.h"
+#include "ThumbnailStore.h"
+
+#include <KConfig>
+#include <KConfigGroup>
 #include <kiconloader.h>
 
+#include <QBuffer>
+#include <QDateTime>
+#include <QFileInfo>
 #include <QIcon>
-#include <QMimeDatabase>
+#include <QImageReader>
 #include <QMutex>
-#include <QThreadPool>
 
 #include <qtquick_debug.h>
 
@@ -39,8 +44,10 @@ class ComicCoverImageProvider::Private
 public:
     Private()
     {
-        // We'll just stick with a 100MiB cache for now - something to expose later maybe?
-        imageCache = new KImageCache("peruse-comiccover", 104857600);
+        // The covers are small enough that this holds a good few thousand of them
+        const KConfig config(QStringLiteral("peruserc"));
+        const qint64 megabytes = qMax(10, config.group(QStringLiteral("general")).readEntry("cover cache size", 100));
+        imageCache = new KImageCache("peruse-comiccover", megabytes * 1024 * 1024);
     }
     ~Private()
     {
@@ -69,7 +76,10 @@ public:
         m_runnable->setAutoDelete(false);
         connect(m_runnable, &ComicCoverRunnable::done, this, &ComicCoverResponse::handleDone, Qt::QueuedConnection);
         connect(this, &QQuickImageResponse::finished, m_runnable, &QObject::deleteLater, Qt::QueuedConnection);
-        QThreadPool::globalInstance()->start(m_runnable);
+        ComicCoverRunnable *runnable = m_runnable;
+        m_ticket = ThumbnailScheduler::instance()->schedule(id, ThumbnailScheduler::ReadStage, [runnable](quint64 ticket) {
+            runnable->runScheduled(ticket);
+        });
     }
 
     void handleDone(QImage image)
@@ -85,10 +95,16 @@ public:
 
     void cancel() override
     {
-        m_runnable->abort();
+        // Work which never started can simply be dropped, anything else has to be told to stop
+        if (ThumbnailScheduler::instance()->cancel(m_ticket)) {
+            Q_EMIT finished();
+        } else {
+            m_runnable->abort();
+        }
     }
 
     ComicCoverRunnable *m_runnable{nullptr};
+    quint64 m_ticket{0};
     QImage m_image;
 };
 
@@ -98,6 +114,11 @@ QQuickImageResponse *ComicCoverImageProvider::requestImageResponse(const QString
     return response;
 }
 
+QList<int> ComicCoverImageProvider::coverBuckets()
+{
+    return ThumbnailStore::sizes();
+}
+
 class ComicCoverRunnable::Private
 {
 public:
@@ -116,30 +137,77 @@ public:
         return abort;
     }
 
-    QStringList entries;
-    void filterImages(QStringList &entries)
+    /**
+     * The smallest bucket which holds a cover at least as large as the requested size,
+     * or the largest bucket if none are that large
+     */
+    int bucketFor(const QSize &size) const
     {
-        /// Sort case-insensitive, then remove non-image entries.
-        QMap<QString, QString> entryMap;
-        for (const QString &entry : std::as_const(entries)) {
-            if (entry.endsWith(QLatin1String(".gif"), Qt::CaseInsensitive) || entry.endsWith(QLatin1String(".jpg"), Qt::CaseInsensitive)
-                || entry.endsWith(QLatin1String(".jpeg"), Qt::CaseInsensitive) || entry.endsWith(QLatin1String(".png"), Qt::CaseInsensitive)) {
-                entryMap.insert(entry.toLower(), entry);
+        const int longEdge = qMax(size.width(), size.height());
+        const QList<int> buckets = ComicCoverImageProvider::coverBuckets();
+        for (int bucket : buckets) {
+            if (bucket >= longEdge) {
+                return bucket;
             }
         }
-        entries = entryMap.values();
+        return buckets.last();
+    }
+
+    /**
+     * The cache key for the cover at the given bucket size. This includes the file's size
+     * and modification time, so a changed book does not get served its old cover.
+     */
+    QString cacheKey(const QFileInfo &info, int bucket) const
+    {
+        return QStringLiteral("%1:%2:%3@%4").arg(id).arg(info.size()).arg(info.lastModified().toMSecsSinceEpoch()).arg(bucket);
     }
-    void getArchiveFileList(QStringList &entries, const QString &prefix, const KArchiveDirectory *dir)
+
+    static QImage scaledToBucket(const QImage &image, int bucket)
     {
-        /// Recursively list all files in the ZIP archive into 'entries'.
-        for (const QString &entry : dir->entries()) {
-            const KArchiveEntry *e = dir->entry(entry);
-            if (e->isDirectory()) {
-                getArchiveFileList(entries, prefix + entry + '/', static_cast<const KArchiveDirectory *>(e));
-            } else if (e->isFile()) {
-                entries.append(prefix + entry);
+        if (qMax(image.width(), image.height()) <= bucket) {
+            return image;
+        }
+        return image.scaled(bucket, bucket, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+
+    QSize ourSize;
+    QFileInfo info;
+    int bucket{0};
+    // Whatever the read stage found to make the cover from, either a larger cached cover, or the raw cover image
+    QImage source;
+    QByteArray coverData;
+    // Whether the cover could not be read, and a placeholder is being used instead
+    bool placeholder{false};
+
+    QImage placeholderCover()
+    {
+        placeholder = true;
+        QIcon oops = QIcon::fromTheme("unknown");
+        return oops.pixmap(oops.availableSizes().last()).toImage();
+    }
+
+    QImage decodeCover(int largestBucket)
+    {
+        QImage img;
+        if (!isAborted() && !coverData.isEmpty()) {
+            QBuffer buffer(&coverData);
+            QImageReader reader(&buffer);
+            // We never need more than the largest bucket, so where the format allows it,
+            // don't bother decoding the full size image only to throw most of it away
+            const QSize fullSize = reader.size();
+            if (fullSize.isValid() && qMax(fullSize.width(), fullSize.height()) > largestBucket && reader.supportsOption(QImageIOHandler::ScaledSize)) {
+                reader.setScaledSize(fullSize.scaled(largestBucket, largestBucket, Qt::KeepAspectRatio));
+            }
+            bool success = reader.read(&img);
+            if (!isAborted() && !success) {
+                img = placeholderCover();
+                // Remember this, so the archive is not opened again on every launch only to fail again
+                ThumbnailStore::storeFailure(id);
+                qCDebug(QTQUICK_LOG) << "Failed to load image with id:" << id;
             }
         }
+        coverData.clear();
+        return img;
     }
 };
 
@@ -164,49 +232,104 @@ void ComicCoverRunnable::abort()
 
 void ComicCoverRunnable::run()
 {
-    QSize ourSize(KIconLoader::SizeEnormous, KIconLoader::SizeEnormous);
+    if (!readStage()) {
+        decodeStage();
+    }
+}
+
+void ComicCoverRunnable::runScheduled(quint64 ticket)
+{
+    if (!readStage()) {
+        ThumbnailScheduler::instance()->continueWith(ticket, ThumbnailScheduler::DecodeStage, [this](quint64) {
+            decodeStage();
+        });
+    }
+}
+
+bool ComicCoverRunnable::readStage()
+{
+    d->ourSize = QSize(KIconLoader::SizeEnormous, KIconLoader::SizeEnormous);
     if (d->requestedSize.width() > 0 && d->requestedSize.height() > 0) {
-        ourSize = d->requestedSize;
+        d->ourSize = d->requestedSize;
     }
 
+    d->info = QFileInfo(d->id);
+    d->bucket = d->bucketFor(d->ourSize);
+
     QImage img;
-    if (!d->imageCache->findImage(d->id, &img)) {
-        KArchive *archive = nullptr;
-        QMimeDatabase db;
-        db.mimeTypeForFile(d->id, QMimeDatabase::MatchContent);
-        const QMimeType mime = db.mimeTypeForFile(d->id, QMimeDatabase::MatchContent);
-        if (!d->isAborted() && (mime.inherits("application/x-cbr") || mime.inherits("application/x-rar"))) {
-            archive = new KRar(d->id);
-        } else if (!d->isAborted() && (mime.inherits("application/x-cbz") || mime.inherits("application/zip"))) {
-            archive = new KZip(d->id);
+    if (d->imageCache->findImage(d->cacheKey(d->info, d->bucket), &img)) {
+        // Covers are put in the atlas when they are made, so this is only for books whose covers were
+        // cached before the atlas was (or since it was started afresh). A larger one will replace it later.
+        if (!CoverAtlas::instance()->contains(d->id)) {
+            CoverAtlas::instance()->insert(d->id, img);
+        }
+        finish(img);
+        return true;
+    }
+
+    // A larger bucket is a much cheaper place to get the cover from than the archive
+    const QList<int> buckets = ComicCoverImageProvider::coverBuckets();
+    for (int larger : buckets) {
+        if (larger > d->bucket && d->imageCache->findImage(d->cacheKey(d->info, larger), &d->source)) {
+            return false;
         }
-        // FIXME: This goes elsewhere - see below
-        // If this code seems familiar, it is adapted from kio-extras/thumbnail/comiccreator.cpp
-        // The reason being that this code should be removed once our karchive-rar functionality is merged into
-        // karchive proper.
-        if (!d->isAborted() && archive && archive->open(QIODevice::ReadOnly)) {
-            // Get the archive's directory.
-            const KArchiveDirectory *cArchiveDir = archive->directory();
-            if (!d->isAborted() && cArchiveDir) {
-                QStringList entries;
-                // Get and filter the entries from the archive.
-                d->getArchiveFileList(entries, QString(), cArchiveDir);
-                d->filterImages(entries);
-                if (!d->isAborted() && !entries.isEmpty()) {
-                    // Extract the cover file.
-                    const KArchiveFile *coverFile = static_cast<const KArchiveFile *>(cArchiveDir->entry(entries[0]));
-                    if (!d->isAborted() && coverFile) {
-                        bool success = img.loadFromData(coverFile->data());
-                        if (!d->isAborted() && !success) {
-                            QIcon oops = QIcon::fromTheme("unknown");
-                            img = oops.pixmap(oops.availableSizes().last()).toImage();
-                            qCDebug(QTQUICK_LOG) << "Failed to load image with id:" << d->id;
-                        }
-                    }
+    }
+
+    // Failing that, the file manager may well have made a thumbnail already
+    d->source = ThumbnailStore::find(d->id, d->bucket);
+    if (!d->source.isNull()) {
+        return false;
+    }
+    if (ThumbnailStore::hasFailed(d->id)) {
+        finish(d->placeholderCover());
+        return true;
+    }
+
+    ArchiveCoverReader coverReader(d->id);
+    if (!d->isAborted() && coverReader.open() && !d->isAborted()) {
+        d->coverData = coverReader.coverData();
+    }
+    if (d->isAborted()) {
+        finish(QImage());
+        return true;
+    }
+    return false;
+}
+
+void ComicCoverRunnable::decodeStage()
+{
+    const QList<int> buckets = ComicCoverImageProvider::coverBuckets();
+    if (d->source.isNull() && !d->isAborted()) {
+        d->source = d->decodeCover(buckets.last());
+        // Having gone to the trouble of opening the archive, fill in all the buckets,
+        // as the same cover is often shown at several sizes (on the shelf and in the details),
+        // and share the requested size with everything else which uses the thumbnail store
+        if (!d->source.isNull() && !d->placeholder && !d->isAborted()) {
+            for (int other : buckets) {
+                if (other != d->bucket) {
+                    d->imageCache->insertImage(d->cacheKey(d->info, other), Private::scaledToBucket(d->source, other));
                 }
             }
+            ThumbnailStore::store(d->id, d->source, d->bucket);
         }
-        d->imageCache->insertImage(d->id, img);
     }
-    Q_EMIT done(img.scaled(ourSize, Qt::KeepAspectRatio, Qt::SmoothTransformation));
+    // The source is the largest cover to hand, so this is the one the atlas gets, for later launches to
+    // get straight from there. The atlas scales it down to its own size, and keeps the largest it is given.
+    if (!d->source.isNull() && !d->placeholder && !d->isAborted()) {
+        CoverAtlas::instance()->insert(d->id, d->source);
+    }
+    const QImage img = Private::scaledToBucket(d->source, d->bucket);
+    d->source = QImage();
+    if (!img.isNull() && !d->placeholder && !d->isAborted()) {
+        d->imageCache->insertImage(d->cacheKey(d->info, d->bucket), img);
+    }
+    finish(img);
+}
+
+void ComicCoverRunnable::finish(QImage img)
+{
+    if (!img.isNull() && (img.width() > d->ourSize.width() || img.height() > d->ourSize.height())) {
+        img = img.scaled(d->ourSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+    Q_EMIT done(img);
 }
@@ -33,6 +33,12 @@
  *
  * TODO This should go into a thumbnailer later, once karchive-rar is merged into KArchive
  *
+ * Covers are cached on disk pre-scaled to a few fixed sizes (see coverBuckets()), and requests
+ * are served from the smallest of those which is at least as large as the requested size. The
+ * size of the cache is set by the "cover cache size" entry in Peruse's configuration.
+ * Before opening the archive, the shared freedesktop thumbnail store (see ThumbnailStore) is
+ * checked for a cover made by a file manager, and covers which had to be made are stored there.
+ *
  * NOTE: As this task is potentially heavy, make sure to mark any Image using this provider asynchronous
  */
 class ComicCoverImageProvider : public QQuickAsyncImageProvider
@@ -45,12 +51,18 @@ public:
      * \brief Get an image.
      *
      * @param id The source of the image.
-     * @param requestedSize The required size of the final image, unused.
+     * @param requestedSize The required size of the final image.
      *
      * @return an asynchronous image response
      */
     QQuickImageResponse *requestImageResponse(const QString &id, const QSize &requestedSize) override;
 
+    /**
+     * @return The sizes, in pixels along the longest edge, at which covers are kept in the cache, smallest first.
+     * These are the same as the sizes of the shared thumbnail store, so covers can be shared with it.
+     */
+    static QList<int> coverBuckets();
+
 private:
     class Private;
     Private *d;
@@ -68,6 +80,15 @@ public:
     virtual ~ComicCoverRunnable();
 
     void run() override;
+    /**
+     * \brief Do the work through the thumbnail scheduler
+     *
+     * Reading the cover from the book happens in the scheduler's read stage, and decoding
+     * it in the decode stage.
+     *
+     * @param ticket The ticket of the job running this
+     */
+    void runScheduled(quint64 ticket);
 
     /**
      * Request that the preview worker abort what it's doing
@@ -81,6 +102,14 @@ public:
     Q_SIGNAL void done(QImage image);
 
 private:
+    /**
+     * Find the cover in the cache, or read it from the book
+     * @return True if the cover was found and done() emitted, false if it still needs decoding
+     */
+    bool readStage();
+    void decodeStage();
+    void finish(QImage img);
+
     class Private;
     std::unique_ptr<Private> d;
 };
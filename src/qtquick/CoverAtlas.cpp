@@ -0,0 +1,441 @@
+// SPDX-FileCopyrightText: 2026 Peruse contributors
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "CoverAtlas.h"
+
+#include <KConfig>
+#include <KConfigGroup>
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStandardPaths>
+#include <QThreadPool>
+
+#include <qtquick_debug.h>
+
+namespace
+{
+constexpr char atlasMagic[] = "PERUSE-ATLAS-1\n";
+// The header is padded out to this size, and every cover starts on a multiple of the alignment
+constexpr qint64 headerSize = 64;
+constexpr qint64 slotAlignment = 64;
+constexpr int maxCoverSize = 256;
+// Below this size, an atlas full of unused covers is not worth the trouble of starting afresh
+constexpr qint64 minimumCompactionSize = 16 * 1024 * 1024;
+// Every cover is stored in this format, which is what the scene graph uploads textures in,
+// so images in it are handed straight on to the graphics driver
+constexpr QImage::Format coverFormat = QImage::Format_RGBA8888_Premultiplied;
+
+struct Slot {
+    qint64 mtime{0};
+    qint64 offset{0};
+    int width{0};
+    int height{0};
+    qint64 bytes() const
+    {
+        return qint64(width) * height * 4;
+    }
+};
+
+struct Segment {
+    qint64 start{0};
+    qint64 end{0};
+    uchar *data{nullptr};
+};
+}
+
+class CoverAtlas::Private
+{
+public:
+    Private()
+    {
+        const QDir location{QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)};
+        if (!location.exists()) {
+            location.mkpath(".");
+        }
+        dbFile = location.absoluteFilePath("library.sqlite");
+        file.setFileName(location.absoluteFilePath("covers.atlas"));
+
+        const KConfig config(QStringLiteral("peruserc"));
+        maxSize = qMax(16, config.group(QStringLiteral("general")).readEntry("cover atlas size", 512)) * qint64(1024 * 1024);
+
+        // The index is written on a single long lived thread, which owns the connection used for it
+        writer.setMaxThreadCount(1);
+        writer.setExpiryTimeout(-1);
+    }
+    ~Private()
+    {
+        writer.start([this]() {
+            flushIndex();
+            {
+                QSqlDatabase db = QSqlDatabase::database(connectionName, false);
+                db.close();
+            }
+            QSqlDatabase::removeDatabase(connectionName);
+        });
+        writer.waitForDone();
+        for (const Segment &segment : std::as_const(segments)) {
+            file.unmap(segment.data);
+        }
+    }
+
+    mutable QMutex mutex;
+    QString dbFile;
+    QFile file;
+    // How much of the file holds completely written covers, and how much of it has been handed
+    // out to covers, some of which may still be being written
+    qint64 fileSize{0};
+    qint64 reservedSize{0};
+    qint64 maxSize{0};
+    bool usable{false};
+    bool full{false};
+    QHash<QString, Slot> index;
+    // The parts of the file which have been mapped, in order. New covers are mapped as they are needed.
+    QList<Segment> segments;
+
+    QThreadPool writer;
+    const QString connectionName{QStringLiteral("peruse-coveratlas")};
+    // Changes to the index waiting to be written, and whether a write has already been queued up
+    QHash<QString, Slot> pendingRows;
+    QStringList pendingRemovals;
+    bool flushQueued{false};
+
+    static const QString &createTable()
+    {
+        static const QString sql{
+            QStringLiteral("CREATE TABLE IF NOT EXISTS cover_atlas(fileName varchar primary key, mtime integer, offset integer, width integer, height integer)")};
+        return sql;
+    }
+
+    void open()
+    {
+        // Read the index in using a connection of our own, as this may happen on any thread
+        const QString loadConnection = connectionName + QStringLiteral("-load");
+        {
+            QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", loadConnection);
+            db.setDatabaseName(dbFile);
+            if (db.open()) {
+                QSqlQuery query(db);
+                query.exec(createTable());
+                query.setForwardOnly(true);
+                if (query.exec("SELECT fileName, mtime, offset, width, height FROM cover_atlas")) {
+                    while (query.next()) {
+                        index.insert(query.value(0).toString(),
+                                     Slot{query.value(1).toLongLong(), query.value(2).toLongLong(), query.value(3).toInt(), query.value(4).toInt()});
+                    }
+                }
+                query.finish();
+
+                openFile();
+                // Anything the file no longer holds is dropped from the index straight away, rather than
+                // on the writer, so the rows are gone by the time anyone else can read them
+                if (!pendingRemovals.isEmpty()) {
+                    db.transaction();
+                    removeRows(db, pendingRemovals);
+                    db.commit();
+                    pendingRemovals.clear();
+                }
+                db.close();
+            } else {
+                qCDebug(QTQUICK_LOG) << "Failed to open the library database for the cover atlas" << db.lastError();
+                openFile();
+            }
+        }
+        QSqlDatabase::removeDatabase(loadConnection);
+    }
+
+    void openFile()
+    {
+        if (!file.open(QIODevice::ReadWrite)) {
+            qCDebug(QTQUICK_LOG) << "Failed to open the cover atlas" << file.fileName() << file.errorString();
+            return;
+        }
+        fileSize = file.size();
+        if (fileSize < headerSize || file.read(sizeof(atlasMagic)) != QByteArray(atlasMagic, sizeof(atlasMagic))) {
+            reset();
+            return;
+        }
+
+        // Anything pointing past the end of the file was never completely written
+        qint64 used{0};
+        for (auto it = index.begin(); it != index.end();) {
+            if (it->offset < headerSize || it->offset + it->bytes() > fileSize) {
+                pendingRemovals << it.key();
+                it = index.erase(it);
+            } else {
+                used += it->bytes();
+                ++it;
+            }
+        }
+        if (fileSize > maxSize || (fileSize > minimumCompactionSize && used < fileSize / 2)) {
+            qCDebug(QTQUICK_LOG) << "Starting the cover atlas afresh, as it holds" << used << "bytes of covers in" << fileSize << "bytes";
+            reset();
+            return;
+        }
+        reservedSize = fileSize;
+        usable = true;
+    }
+
+    void reset()
+    {
+        index.clear();
+        pendingRows.clear();
+        pendingRemovals.clear();
+        pendingRemovals << QString();
+
+        QByteArray header(atlasMagic, sizeof(atlasMagic));
+        header.append(QByteArray(headerSize - header.size(), '\0'));
+        if (!file.resize(0) || !file.seek(0) || file.write(header) != headerSize || !file.flush()) {
+            qCDebug(QTQUICK_LOG) << "Failed to set up the cover atlas" << file.fileName() << file.errorString();
+            return;
+        }
+        fileSize = headerSize;
+        reservedSize = headerSize;
+        usable = true;
+    }
+
+    static void removeRows(QSqlDatabase &db, const QStringList &fileNames)
+    {
+        QSqlQuery query(db);
+        for (const QString &fileName : fileNames) {
+            // An empty filename stands in for every cover, for when the atlas is started afresh
+            if (fileName.isEmpty()) {
+                query.exec(QStringLiteral("DELETE FROM cover_atlas"));
+            } else {
+                query.prepare(QStringLiteral("DELETE FROM cover_atlas WHERE fileName=:filename"));
+                query.bindValue(":filename", fileName);
+                query.exec();
+            }
+        }
+        query.finish();
+    }
+
+    // Must be called with the mutex held
+    const uchar *dataFor(const Slot &slot)
+    {
+        for (const Segment &segment : std::as_const(segments)) {
+            if (slot.offset >= segment.start && slot.offset + slot.bytes() <= segment.end) {
+                return segment.data + (slot.offset - segment.start);
+            }
+        }
+        // Map everything written since the last time, which will include this cover
+        const qint64 mappedEnd = segments.isEmpty() ? headerSize : segments.last().end;
+        if (slot.offset >= mappedEnd && slot.offset + slot.bytes() <= fileSize) {
+            uchar *data = file.map(mappedEnd, fileSize - mappedEnd);
+            if (data) {
+                segments << Segment{mappedEnd, fileSize, data};
+                return data + (slot.offset - mappedEnd);
+            }
+            qCDebug(QTQUICK_LOG) << "Failed to map the cover atlas" << file.errorString();
+        }
+        return nullptr;
+    }
+
+    // Must be called with the mutex held
+    void queueFlush()
+    {
+        if (flushQueued) {
+            return;
+        }
+        flushQueued = true;
+        writer.start([this]() {
+            flushIndex();
+        });
+    }
+
+    // Runs on the writer thread
+    void flushIndex()
+    {
+        QHash<QString, Slot> rows;
+        QStringList removals;
+        {
+            QMutexLocker locker(&mutex);
+            rows.swap(pendingRows);
+            removals.swap(pendingRemovals);
+            flushQueued = false;
+        }
+        if (rows.isEmpty() && removals.isEmpty()) {
+            return;
+        }
+
+        QSqlDatabase db = QSqlDatabase::database(connectionName, false);
+        if (!db.isValid()) {
+            db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+            db.setDatabaseName(dbFile);
+        }
+        if (!db.isOpen()) {
+            if (!db.open()) {
+                qCDebug(QTQUICK_LOG) << "Failed to open the library database for the cover atlas" << db.lastError();
+                return;
+            }
+            QSqlQuery setup(db);
+            setup.exec(QStringLiteral("PRAGMA synchronous=NORMAL"));
+            setup.exec(createTable());
+        }
+
+        db.transaction();
+        removeRows(db, removals);
+        QSqlQuery query(db);
+        query.prepare(QStringLiteral("INSERT OR REPLACE INTO cover_atlas (fileName, mtime, offset, width, height) VALUES (:filename, :mtime, :offset, :width, :height)"));
+        for (auto it = rows.constBegin(); it != rows.constEnd(); ++it) {
+            query.bindValue(":filename", it.key());
+            query.bindValue(":mtime", it->mtime);
+            query.bindValue(":offset", it->offset);
+            query.bindValue(":width", it->width);
+            query.bindValue(":height", it->height);
+            if (!query.exec()) {
+                qCDebug(QTQUICK_LOG) << "Failed to add the cover for" << it.key() << "to the cover atlas index" << query.lastError();
+            }
+        }
+        query.finish();
+        db.commit();
+    }
+};
+
+CoverAtlas *CoverAtlas::instance()
+{
+    static CoverAtlas *atlas = new CoverAtlas();
+    return atlas;
+}
+
+CoverAtlas::CoverAtlas()
+    : d(new Private)
+{
+    QMutexLocker locker(&d->mutex);
+    d->open();
+}
+
+CoverAtlas::~CoverAtlas()
+{
+    delete d;
+}
+
+int CoverAtlas::maximumCoverSize()
+{
+    return maxCoverSize;
+}
+
+QImage CoverAtlas::cover(const QString &fileName)
+{
+    Slot slot;
+    {
+        QMutexLocker locker(&d->mutex);
+        const auto it = d->index.constFind(fileName);
+        if (it == d->index.constEnd()) {
+            return QImage();
+        }
+        slot = it.value();
+    }
+
+    const QFileInfo info(fileName);
+    if (!info.exists() || info.lastModified().toMSecsSinceEpoch() != slot.mtime) {
+        // The book has changed (or gone) since its cover was stored, so get rid of the old cover,
+        // and the next time the shelves are loaded, the book's cover will be made afresh
+        QMutexLocker locker(&d->mutex);
+        if (d->index.remove(fileName) > 0) {
+            d->pendingRows.remove(fileName);
+            d->pendingRemovals << fileName;
+            d->queueFlush();
+        }
+        return QImage();
+    }
+
+    QMutexLocker locker(&d->mutex);
+    const uchar *data = d->dataFor(slot);
+    if (!data) {
+        return QImage();
+    }
+    // The const constructor means the image never writes to (or copies) the mapping
+    return QImage(data, slot.width, slot.height, slot.width * 4, coverFormat);
+}
+
+bool CoverAtlas::contains(const QString &fileName) const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->index.contains(fileName);
+}
+
+void CoverAtlas::insert(const QString &fileName, const QImage &image)
+{
+    if (image.isNull()) {
+        return;
+    }
+    const QFileInfo info(fileName);
+    if (!info.exists()) {
+        return;
+    }
+    const qint64 mtime = info.lastModified().toMSecsSinceEpoch();
+    // An up to date cover is only replaced by a larger one, so a cover first made for a small
+    // delegate does not end up stretched across every shelf tile after it
+    const int longEdge = qMin(maxCoverSize, qMax(image.width(), image.height()));
+    auto isStored = [this, &fileName, mtime, longEdge]() {
+        const auto it = d->index.constFind(fileName);
+        return it != d->index.constEnd() && it->mtime == mtime && qMax(it->width, it->height) >= longEdge;
+    };
+    {
+        QMutexLocker locker(&d->mutex);
+        if (!d->usable || d->full || isStored()) {
+            return;
+        }
+    }
+
+    QImage cover = image;
+    if (qMax(cover.width(), cover.height()) > maxCoverSize) {
+        cover = cover.scaled(maxCoverSize, maxCoverSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+    cover.convertTo(coverFormat);
+    const Slot sized{mtime, 0, cover.width(), cover.height()};
+
+    // Only room for the cover is set aside while holding the mutex, so that writing it out does
+    // not hold up covers being handed out on the gui thread
+    qint64 offset{0};
+    {
+        QMutexLocker locker(&d->mutex);
+        if (!d->usable || isStored()) {
+            return;
+        }
+        offset = (d->reservedSize + slotAlignment - 1) / slotAlignment * slotAlignment;
+        if (offset + sized.bytes() > d->maxSize) {
+            qCDebug(QTQUICK_LOG) << "The cover atlas is full, no more covers will be added to it";
+            d->full = true;
+            return;
+        }
+        d->reservedSize = offset + sized.bytes();
+    }
+
+    // Each write goes through a handle of its own, as several covers may be written at the same time
+    QFile output(d->file.fileName());
+    bool written = output.open(QIODevice::ReadWrite) && output.seek(offset);
+    const qint64 lineBytes = qint64(cover.width()) * 4;
+    for (int line = 0; written && line < cover.height(); ++line) {
+        written = output.write(reinterpret_cast<const char *>(cover.constScanLine(line)), lineBytes) == lineBytes;
+    }
+    // The cover has to be on disk before it can be mapped
+    written = written && output.flush();
+    if (!written) {
+        qCDebug(QTQUICK_LOG) << "Failed to write to the cover atlas" << output.errorString();
+    }
+    output.close();
+
+    QMutexLocker locker(&d->mutex);
+    if (!written) {
+        d->usable = false;
+        return;
+    }
+    // Covers written at the same time may finish in any order. Those not yet finished are not in
+    // the index, so nothing will look at them until they are.
+    d->fileSize = qMax(d->fileSize, offset + sized.bytes());
+
+    Slot slot = sized;
+    slot.offset = offset;
+    d->index.insert(fileName, slot);
+    d->pendingRows.insert(fileName, slot);
+    d->queueFlush();
+}
@@ -0,0 +1,74 @@
+// SPDX-FileCopyrightText: 2026 Peruse contributors
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#ifndef COVERATLAS_H
+#define COVERATLAS_H
+
+#include <QImage>
+#include <QString>
+
+/**
+ * \brief A single file holding ready to use covers for every book on the shelves
+ *
+ * The covers are stored one after the other in an append-only file (covers.atlas, next to the
+ * library database), already scaled down and in the pixel format the scene graph uploads textures
+ * in, and the file is memory mapped, so a cover can be handed out as an image pointing straight
+ * into the mapping, with no decoding or copying at all. Where in the file each book's cover is
+ * stored is kept in the cover_atlas table of the library database, which the book database reads
+ * to decide which books get their covers from the atlas (see CoverAtlasImageProvider).
+ *
+ * Covers are added by the other cover providers as they make them. Once the file grows past the
+ * "cover atlas size" entry in Peruse's configuration (in MiB), no more covers are added, and the
+ * file is started afresh the next time it is opened if it is too large, or mostly holds covers
+ * which are no longer used.
+ *
+ * All functions are safe to call from any thread.
+ */
+class CoverAtlas
+{
+public:
+    /**
+     * @return The atlas shared by all the cover providers
+     */
+    static CoverAtlas *instance();
+    ~CoverAtlas();
+
+    /**
+     * @return The largest size, in pixels along the longest edge, covers are stored at
+     */
+    static int maximumCoverSize();
+
+    /**
+     * \brief Get the cover for a book
+     *
+     * The image shares its data with the atlas file's mapping, and so is only ever read from.
+     * A cover stored for an older version of the file than the one now on disk is dropped from
+     * the index, and the book's cover is made afresh by the provider the shelves fall back on.
+     *
+     * @param fileName The local filename of the book
+     * @return The cover, or a null image if there is no up to date cover for the book
+     */
+    QImage cover(const QString &fileName);
+    /**
+     * @param fileName The local filename of the book
+     * @return True if the atlas holds a cover for the book (whether or not it is up to date)
+     */
+    bool contains(const QString &fileName) const;
+    /**
+     * \brief Add the cover for a book
+     *
+     * This does nothing if the atlas already holds an up to date cover for the book which is at
+     * least as large, or is full. A smaller cover is replaced.
+     *
+     * @param fileName The local filename of the book
+     * @param image The cover. If this is larger than maximumCoverSize() it is scaled down.
+     */
+    void insert(const QString &fileName, const QImage &image);
+
+private:
+    CoverAtlas();
+    class Private;
+    Private *d;
+};
+
+#endif // COVERATLAS_H
@@ -0,0 +1,34 @@
+// SPDX-FileCopyrightText: 2026 Peruse contributors
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "CoverAtlasImageProvider.h"
+
+#include "CoverAtlas.h"
+
+CoverAtlasImageProvider::CoverAtlasImageProvider()
+    : QQuickImageProvider(QQuickImageProvider::Image)
+{
+    // Open the atlas now, rather than on the first frame
+    CoverAtlas::instance();
+}
+
+CoverAtlasImageProvider::~CoverAtlasImageProvider() = default;
+
+QImage CoverAtlasImageProvider::requestImage(const QString &id, QSize *size, const QSize & /*requestedSize*/)
+{
+    // The id is the url of the book's usual thumbnail, the last part of which is the book's filename
+    QString adjustedId{id};
+    if (adjustedId.startsWith(QStringLiteral("image://"))) {
+        adjustedId = adjustedId.mid(adjustedId.indexOf(QLatin1Char('/'), 8) + 1);
+    }
+    // We sometimes get malformed IDs (that is, extra slashes at the start), so fix those up
+    while (adjustedId.startsWith("//")) {
+        adjustedId = adjustedId.mid(1);
+    }
+    // Scaling would mean a copy, and the scene graph scales the texture anyway
+    const QImage cover = CoverAtlas::instance()->cover(adjustedId);
+    if (size) {
+        *size = cover.size();
+    }
+    return cover;
+}
@@ -0,0 +1,41 @@
+// SPDX-FileCopyrightText: 2026 Peruse contributors
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#ifndef COVERATLASIMAGEPROVIDER_H
+#define COVERATLASIMAGEPROVIDER_H
+
+#include <QQuickImageProvider>
+
+/**
+ * \brief Serve book covers straight out of the cover atlas
+ *
+ * Unlike the other cover providers, this one is synchronous: a cover in the atlas is ready to be
+ * uploaded as it is, so there is nothing to wait for, and the covers of the first screenful of
+ * books are there on the very first frame. The book database hands out image://atlascover/ urls
+ * only for books which have a cover in the atlas, and everything else goes through the other providers,
+ * which add the covers they make to the atlas.
+ *
+ * The id is the url the book's cover would otherwise be fetched from (for example
+ * image://atlascover/image://comiccover//home/leinir/boop.cbz). Should the atlas not have an up to
+ * date cover after all, the request fails, and whatever shows the cover falls back on that url.
+ *
+ * @see CoverAtlas
+ */
+class CoverAtlasImageProvider : public QQuickImageProvider
+{
+public:
+    explicit CoverAtlasImageProvider();
+    ~CoverAtlasImageProvider() override;
+
+    /**
+     * \brief Get the cover for a book
+     *
+     * @param id The url of the book's usual thumbnail (or simply the book's local filename)
+     * @param size Set to the size of the cover
+     * @param requestedSize Unused, the cover is always handed out at the size it is stored at
+     * @return The cover, or a null image if the atlas has no up to date cover for the book
+     */
+    QImage requestImage(const QString &id, QSize *size, const QSize &requestedSize) override;
+};
+
+#endif // COVERATLASIMAGEPROVIDER_H
@@ -0,0 +1,261 @@
+// SPDX-FileCopyrightText: 2026 Peruse contributors
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "GhostscriptThumbnailer.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QList>
+#include <QMutex>
+#include <QProcess>
+#include <QSet>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QThreadPool>
+
+#include <qtquick_debug.h>
+
+#include <cmath>
+
+namespace
+{
+// The most files handed to a single gs process
+constexpr int maxBatchSize = 16;
+// How long gs gets to start up, and then how long it gets for each file, before it is killed
+constexpr int startupTimeout = 5000;
+constexpr int perFileTimeout = 10000;
+
+struct Request {
+    quint64 ticket{0};
+    QString fileName;
+    QString outFile;
+    int resolution{0};
+    std::function<void(bool)> done;
+};
+
+QString ghostscriptApp()
+{
+    QString gsApp;
+#ifdef Q_OS_WIN
+#ifdef __MINGW32__
+    gsApp = qApp->applicationDirPath() + "/gsc.exe";
+#else
+    gsApp = qApp->applicationDirPath();
+#ifdef Q_OS_WIN64
+    gsApp += "/gswin64c.exe";
+#else
+    gsApp += "/gswin32c.exe";
+#endif
+#endif
+#else
+    gsApp = "gs";
+#endif
+    return gsApp;
+}
+
+/**
+ * Render the first page of each file in the batch into the given directory, as page-1.png,
+ * page-2.png and so on, in the same order as the files
+ * @return True if gs ran to completion, and produced exactly one page for each file
+ */
+bool renderBatch(const QList<Request> &batch, const QString &outDir)
+{
+    // Clear out anything left over from an earlier attempt, so it cannot be mistaken for this one's pages
+    QDir dir(outDir);
+    const QStringList leftovers = dir.entryList({QStringLiteral("page-*.png")}, QDir::Files);
+    for (const QString &leftover : leftovers) {
+        dir.remove(leftover);
+    }
+
+    QStringList args;
+    args << "-dSAFER" << "-dBATCH" << "-dNOPAUSE" << "-dQUIET" << "-sDEVICE=png16m" << "-dGraphicsAlphaBits=4" << "-dTextAlphaBits=4"
+         << "-dFirstPage=1" << "-dLastPage=1";
+    args << QString("-r%1").arg(batch.first().resolution);
+    args << QString("-sOutputFile=%1/page-%d.png").arg(outDir);
+    for (const Request &request : batch) {
+        args << request.fileName;
+    }
+
+    QProcess gs;
+    gs.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    gs.setStandardOutputFile(QProcess::nullDevice());
+    gs.start(ghostscriptApp(), args);
+    if (!gs.waitForStarted(startupTimeout)) {
+        qCDebug(QTQUICK_LOG) << "Failed to start Ghostscript to thumbnail" << batch.count() << "files:" << gs.errorString();
+        return false;
+    }
+    if (!gs.waitForFinished(startupTimeout + perFileTimeout * batch.count())) {
+        qCDebug(QTQUICK_LOG) << "Ghostscript took too long to thumbnail" << batch.count() << "files, starting with" << batch.first().fileName;
+        gs.kill();
+        gs.waitForFinished();
+        return false;
+    }
+    if (gs.exitStatus() != QProcess::NormalExit || gs.exitCode() != 0) {
+        return false;
+    }
+    // A file gs could not make sense of would shift the pages of all the files after it along,
+    // so unless every file has exactly one page, none of the pages can be trusted
+    for (int page = 1; page <= batch.count(); ++page) {
+        if (!dir.exists(QString("page-%1.png").arg(page))) {
+            return false;
+        }
+    }
+    return !dir.exists(QString("page-%1.png").arg(batch.count() + 1));
+}
+
+bool moveInto(const QString &from, const QString &to)
+{
+    QFile::remove(to);
+    return QFile::rename(from, to);
+}
+}
+
+class GhostscriptThumbnailer::Private
+{
+public:
+    Private()
+    {
+        maxRunning = qMax(1, QThread::idealThreadCount());
+        pool.setMaxThreadCount(maxRunning);
+    }
+    QThreadPool pool;
+
+    QMutex mutex;
+    quint64 nextTicket{1};
+    int running{0};
+    int maxRunning{1};
+    QList<Request> pending;
+    // The tickets of the requests currently being rendered, and those of them which have been cancelled
+    QSet<quint64> inFlight;
+    QSet<quint64> cancelled;
+
+    // Must be called with the mutex held. Requests only get batched up while all the workers
+    // are busy, so when the thumbnailer is idle, a request is started straight away on its own.
+    void dispatch()
+    {
+        while (running < maxRunning && !pending.isEmpty()) {
+            QList<Request> batch;
+            batch << pending.takeFirst();
+            for (int i = 0; i < pending.count() && batch.count() < maxBatchSize;) {
+                if (pending.at(i).resolution == batch.first().resolution) {
+                    batch << pending.takeAt(i);
+                } else {
+                    ++i;
+                }
+            }
+            for (const Request &request : std::as_const(batch)) {
+                inFlight.insert(request.ticket);
+            }
+            ++running;
+            pool.start([this, batch]() {
+                run(batch);
+            });
+        }
+    }
+
+    void run(const QList<Request> &batch)
+    {
+        QList<bool> results(batch.count(), false);
+        // Keep the temporary files next to the thumbnails, so they can be renamed into place
+        QTemporaryDir outDir(QFileInfo(batch.first().outFile).absolutePath() + "/gs-XXXXXX");
+        if (outDir.isValid() && renderBatch(batch, outDir.path())) {
+            for (int i = 0; i < batch.count(); ++i) {
+                results[i] = moveInto(QString("%1/page-%2.png").arg(outDir.path()).arg(i + 1), batch.at(i).outFile);
+            }
+        } else if (outDir.isValid() && batch.count() > 1) {
+            qCDebug(QTQUICK_LOG) << "Ghostscript batch of" << batch.count() << "files failed, rendering them one at a time";
+            for (int i = 0; i < batch.count(); ++i) {
+                {
+                    QMutexLocker locker(&mutex);
+                    if (cancelled.contains(batch.at(i).ticket)) {
+                        continue;
+                    }
+                }
+                if (renderBatch({batch.at(i)}, outDir.path())) {
+                    results[i] = moveInto(QString("%1/page-1.png").arg(outDir.path()), batch.at(i).outFile);
+                }
+            }
+        }
+
+        QList<bool> wasCancelled(batch.count(), false);
+        {
+            QMutexLocker locker(&mutex);
+            for (int i = 0; i < batch.count(); ++i) {
+                inFlight.remove(batch.at(i).ticket);
+                wasCancelled[i] = cancelled.remove(batch.at(i).ticket);
+            }
+            --running;
+            dispatch();
+        }
+        for (int i = 0; i < batch.count(); ++i) {
+            batch.at(i).done(results.at(i) && !wasCancelled.at(i));
+        }
+    }
+};
+
+GhostscriptThumbnailer *GhostscriptThumbnailer::instance()
+{
+    static GhostscriptThumbnailer *thumbnailer = new GhostscriptThumbnailer();
+    return thumbnailer;
+}
+
+GhostscriptThumbnailer::GhostscriptThumbnailer(QObject *parent)
+    : QObject(parent)
+    , d(new Private)
+{
+}
+
+GhostscriptThumbnailer::~GhostscriptThumbnailer()
+{
+    QList<Request> dropped;
+    {
+        QMutexLocker locker(&d->mutex);
+        dropped.swap(d->pending);
+    }
+    for (const Request &request : std::as_const(dropped)) {
+        request.done(false);
+    }
+    d->pool.waitForDone();
+    delete d;
+}
+
+quint64 GhostscriptThumbnailer::thumbnail(const QString &fileName, const QString &outFile, const QSize &size, const std::function<void(bool)> &done)
+{
+    QMutexLocker locker(&d->mutex);
+    const quint64 ticket = d->nextTicket++;
+    d->pending << Request{ticket, fileName, outFile, resolutionForSize(size), done};
+    d->dispatch();
+    return ticket;
+}
+
+void GhostscriptThumbnailer::cancel(quint64 ticket)
+{
+    std::function<void(bool)> done;
+    {
+        QMutexLocker locker(&d->mutex);
+        for (int i = 0; i < d->pending.count(); ++i) {
+            if (d->pending.at(i).ticket == ticket) {
+                done = d->pending.takeAt(i).done;
+                break;
+            }
+        }
+        if (!done && d->inFlight.contains(ticket)) {
+            d->cancelled.insert(ticket);
+        }
+    }
+    if (done) {
+        done(false);
+    }
+}
+
+int GhostscriptThumbnailer::resolutionForSize(const QSize &size)
+{
+    if (size.width() <= 0 || size.height() <= 0) {
+        return 150;
+    }
+    // An A4 page is 595 by 842 points, at 72 points to the inch
+    const double resolution = 72.0 * qMax(size.width() / 595.0, size.height() / 842.0);
+    return qBound(18, int(std::ceil(resolution)), 600);
+}
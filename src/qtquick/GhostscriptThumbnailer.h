@@ -0,0 +1,69 @@
+// SPDX-FileCopyrightText: 2026 Peruse contributors
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#ifndef GHOSTSCRIPTTHUMBNAILER_H
+#define GHOSTSCRIPTTHUMBNAILER_H
+
+#include <QObject>
+#include <QSize>
+#include <QString>
+
+#include <functional>
+
+/**
+ * \brief Renders the first page of PDF files to PNG using Ghostscript, a batch at a time
+ *
+ * Starting the Ghostscript interpreter takes far longer than rendering the first page of most
+ * PDF files, so rather than starting one gs process per file, requests for the same size are
+ * gathered up and handed to a single gs process together. No more gs processes than there are
+ * cores are run at the same time, and each process is killed if it runs for longer than it
+ * should for the number of files it was given.
+ *
+ * If a batch fails, or does not produce a page for each file, the files in it are rendered one
+ * by one instead, so one broken file does not cost the rest of the batch their thumbnails.
+ */
+class GhostscriptThumbnailer : public QObject
+{
+    Q_OBJECT
+public:
+    /**
+     * @return The thumbnailer shared by everything which needs PDF thumbnails
+     */
+    static GhostscriptThumbnailer *instance();
+    ~GhostscriptThumbnailer() override;
+
+    /**
+     * \brief Queue up a PDF file for thumbnailing
+     *
+     * @param fileName The local filename of the PDF file
+     * @param outFile Where to write the thumbnail (as a PNG file)
+     * @param size The size the thumbnail is wanted at. The first page is rendered at the lowest
+     * resolution which will be at least this large for pages of A4 size and above.
+     * @param done Called once the thumbnail has been written, with true if it was written
+     * successfully. This is called exactly once for each request, on a worker thread, including
+     * when the request is cancelled (in which case it is passed false).
+     * @return A ticket identifying the request, for use with cancel()
+     */
+    quint64 thumbnail(const QString &fileName, const QString &outFile, const QSize &size, const std::function<void(bool)> &done);
+    /**
+     * \brief Cancel a request
+     *
+     * If the request is still queued up it is removed, and its callback is called straight away.
+     * If it is already being rendered, it will still be, but the callback will be passed false.
+     * @param ticket The ticket of the request to cancel
+     */
+    void cancel(quint64 ticket);
+
+    /**
+     * @param size The size a thumbnail is wanted at
+     * @return The resolution, in dots per inch, a page is rendered at for that size
+     */
+    static int resolutionForSize(const QSize &size);
+
+private:
+    explicit GhostscriptThumbnailer(QObject *parent = nullptr);
+    class Private;
+    Private *d;
+};
+
+#endif // GHOSTSCRIPTTHUMBNAILER_H
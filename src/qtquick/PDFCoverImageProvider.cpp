@@ -20,17 +20,21 @@
  */
 
 #include "PDFCoverImageProvider.h"
+#include "CoverAtlas.h"
+#include "GhostscriptThumbnailer.h"
+#include "ThumbnailScheduler.h"
+#include "ThumbnailStore.h"
 
 #include <kiconloader.h>
 
-#include <QCoreApplication>
+#include <QDateTime>
 #include <QDir>
+#include <QFile>
+#include <QFileInfo>
 #include <QIcon>
 #include <QMimeDatabase>
 #include <QMutex>
-#include <QProcess>
 #include <QStandardPaths>
-#include <QThreadPool>
 #include <QUrl>
 
 #include <qtquick_debug.h>
@@ -71,7 +75,11 @@ public:
         m_runnable->setAutoDelete(false);
         connect(m_runnable, &PDFCoverRunnable::done, this, &PDFCoverResponse::handleDone, Qt::QueuedConnection);
         connect(this, &QQuickImageResponse::finished, m_runnable, &QObject::deleteLater, Qt::QueuedConnection);
-        QThreadPool::globalInstance()->start(m_runnable);
+        PDFCoverRunnable *runnable = m_runnable;
+        // Both waiting on another process and reading the file are mostly waiting, so this all counts as reading
+        m_ticket = ThumbnailScheduler::instance()->schedule(id, ThumbnailScheduler::ReadStage, [runnable](quint64) {
+            runnable->run();
+        });
     }
 
     void handleDone(QImage image)
@@ -87,10 +95,16 @@ public:
 
     void cancel() override
     {
-        m_runnable->abort();
+        // Work which never started can simply be dropped, anything else has to be told to stop
+        if (ThumbnailScheduler::instance()->cancel(m_ticket)) {
+            Q_EMIT finished();
+        } else {
+            m_runnable->abort();
+        }
     }
 
     PDFCoverRunnable *m_runnable{nullptr};
+    quint64 m_ticket{0};
     QImage m_image;
 };
 
@@ -110,6 +124,8 @@ public:
     QSize requestedSize;
 
     bool abort{false};
+    // The Ghostscript request for the thumbnail, if one has been made
+    quint64 ticket{0};
     QMutex abortMutex;
     bool isAborted()
     {
@@ -118,7 +134,6 @@ public:
     }
 
     QDir thumbDir;
-    QProcess thumbnailer;
 };
 
 PDFCoverRunnable::PDFCoverRunnable(const QString &id, const QSize &requestedSize, const QDir &thumbDir)
@@ -131,61 +146,88 @@ PDFCoverRunnable::PDFCoverRunnable(const QString &id, const QSize &requestedSize
 
 void PDFCoverRunnable::abort()
 {
-    QMutexLocker locker(&d->abortMutex);
-    d->abort = true;
-    d->thumbnailer.kill();
+    quint64 ticket{0};
+    {
+        QMutexLocker locker(&d->abortMutex);
+        d->abort = true;
+        ticket = d->ticket;
+    }
+    if (ticket > 0) {
+        GhostscriptThumbnailer::instance()->cancel(ticket);
+    }
 }
 
 void PDFCoverRunnable::run()
 {
-    QImage img;
-
     QSize ourSize(KIconLoader::SizeEnormous, KIconLoader::SizeEnormous);
     if (d->requestedSize.width() > 0 && d->requestedSize.height() > 0) {
         ourSize = d->requestedSize;
     }
 
+    // Someone may well have made a thumbnail already, in which case the file need not even be opened
+    const int storeSize = ThumbnailStore::sizeFor(ourSize);
+    const QImage stored = ThumbnailStore::find(d->id, storeSize);
+    if (!stored.isNull()) {
+        // The atlas keeps the largest cover it is given, so a small thumbnail only goes in if there is nothing yet
+        if (!CoverAtlas::instance()->contains(d->id)) {
+            CoverAtlas::instance()->insert(d->id, stored);
+        }
+        Q_EMIT done(stored.scaled(ourSize, Qt::KeepAspectRatio, Qt::SmoothTransformation));
+        return;
+    }
+
     QMimeDatabase db;
-    db.mimeTypeForFile(d->id, QMimeDatabase::MatchContent);
     const QMimeType mime = db.mimeTypeForFile(d->id, QMimeDatabase::MatchContent);
-    if (!d->isAborted() && mime.inherits("application/pdf")) {
-        //-sOutputFile=FILENAME.png FILENAME
-        QString outFile = QString("%1/%2.png").arg(d->thumbDir.absolutePath()).arg(QUrl(d->id).toString().replace("/", "-").replace(":", "-"));
-        if (!d->isAborted() && !QFile::exists(outFile)) {
-            // then we've not already generated a thumbnail, try to make one...
-            QStringList args;
-            args << "-sPageList=1" << "-dLastPage=1" << "-dSAFER" << "-dBATCH" << "-dNOPAUSE" << "-dQUIET" << "-sDEVICE=png16m" << "-dGraphicsAlphaBits=4"
-                 << "-r150";
-            args << QString("-sOutputFile=%1").arg(outFile) << d->id;
-            QString gsApp;
-#ifdef Q_OS_WIN
-#ifdef __MINGW32__
-            gsApp = qApp->applicationDirPath() + "/gsc.exe";
-#else
-            gsApp = qApp->applicationDirPath();
-#ifdef Q_OS_WIN64
-            gsApp += "/gswin64c.exe";
-#else
-            gsApp += "/gswin32c.exe";
-#endif
-#endif
-#else
-            gsApp = "gs";
-#endif
-            d->thumbnailer.start(gsApp, args);
-            d->thumbnailer.waitForFinished();
-        }
-        bool success = false;
-        // Now, does it exist this time?
-        if (!d->isAborted() && QFile::exists(outFile)) {
-            success = img.load(outFile);
-        }
-        if (!d->isAborted() && !success) {
-            QIcon oops = QIcon::fromTheme("application-pdf");
-            img = oops.pixmap(oops.availableSizes().last()).toImage();
-            qCDebug(QTQUICK_LOG) << "Failed to load image with id" << d->id << "from thumbnail file" << outFile;
-        }
+    if (d->isAborted() || !mime.inherits("application/pdf")) {
+        Q_EMIT done(QImage());
+        return;
+    }
+
+    // The page is rendered at a resolution to suit the thumbnail store's size, so keep one rendering per resolution.
+    // That is never less than the atlas size, so the atlas gets a cover which looks right on the shelves.
+    const int atlasStoreSize = ThumbnailStore::sizeFor(QSize(CoverAtlas::maximumCoverSize(), CoverAtlas::maximumCoverSize()));
+    const QSize renderSize(qMax(storeSize, atlasStoreSize), qMax(storeSize, atlasStoreSize));
+    const QString outFile = QString("%1/%2@%3.png")
+                                .arg(d->thumbDir.absolutePath())
+                                .arg(QUrl(d->id).toString().replace("/", "-").replace(":", "-"))
+                                .arg(GhostscriptThumbnailer::resolutionForSize(renderSize));
+    // An old rendering of a file which has since changed is no use
+    const QFileInfo outInfo(outFile);
+    if (outInfo.exists() && outInfo.lastModified() >= QFileInfo(d->id).lastModified()) {
+        finish(outFile, ourSize, storeSize);
+        return;
+    }
+
+    // Then we've not already generated a thumbnail, so have one made. This does not block the
+    // thread while waiting, and finishes up on one of the thumbnailer's threads instead.
+    QMutexLocker locker(&d->abortMutex);
+    if (d->abort) {
+        locker.unlock();
+        Q_EMIT done(QImage());
+        return;
+    }
+    d->ticket = GhostscriptThumbnailer::instance()->thumbnail(d->id, outFile, renderSize, [this, outFile, ourSize, storeSize](bool) {
+        finish(outFile, ourSize, storeSize);
+    });
+}
+
+void PDFCoverRunnable::finish(const QString &outFile, const QSize &size, int storeSize)
+{
+    QImage img;
+    bool success = false;
+    // Now, does it exist this time?
+    if (!d->isAborted() && QFile::exists(outFile)) {
+        success = img.load(outFile);
+    }
+    if (success && !d->isAborted()) {
+        ThumbnailStore::store(d->id, img, storeSize);
+        CoverAtlas::instance()->insert(d->id, img);
+    }
+    if (!d->isAborted() && !success) {
+        QIcon oops = QIcon::fromTheme("application-pdf");
+        img = oops.pixmap(oops.availableSizes().last()).toImage();
+        qCDebug(QTQUICK_LOG) << "Failed to load image with id" << d->id << "from thumbnail file" << outFile;
     }
 
-    Q_EMIT done(img.scaled(ourSize, Qt::KeepAspectRatio, Qt::SmoothTransformation));
+    Q_EMIT done(img.scaled(size, Qt::KeepAspectRatio, Qt::SmoothTransformation));
 }
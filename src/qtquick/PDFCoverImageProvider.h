@@ -76,6 +76,12 @@ public:
     Q_SIGNAL void done(QImage image);
 
 private:
+    /**
+     * Load the thumbnail Ghostscript has written (or a placeholder, if it failed), share it with the
+     * thumbnail store at the given size, and hand it on through done()
+     */
+    void finish(const QString &outFile, const QSize &size, int storeSize);
+
     class Private;
     Private *d;
 };
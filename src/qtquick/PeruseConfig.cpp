@@ -20,6 +20,7 @@
  */
 
 #include "PeruseConfig.h"
+#include "BookMetadataIngester.h"
 
 #include <KConfig>
 #include <KConfigGroup>
@@ -175,6 +176,21 @@ void PeruseConfig::setAnimateJumpAreas(bool animate)
     }
 }
 
+int PeruseConfig::coverCacheSize() const
+{
+    return d->config.group(u"general"_s).readEntry(u"cover cache size"_s, 100);
+}
+
+void PeruseConfig::setCoverCacheSize(int megabytes)
+{
+    megabytes = qMax(10, megabytes);
+    if (coverCacheSize() != megabytes) {
+        d->config.group(u"general"_s).writeEntry(u"cover cache size"_s, megabytes);
+        d->config.sync();
+        emit coverCacheSizeChanged();
+    }
+}
+
 QString PeruseConfig::homeDir() const
 {
     return QStandardPaths::standardLocations(QStandardPaths::HomeLocation).first();
@@ -192,6 +208,7 @@ void PeruseConfig::setFilesystemProperty(QString fileName, QString propertyName,
     } else {
         data.setAttribute(QString("peruse.").append(propertyName), value);
     }
+    BookMetadataIngester::forgetUserMetadata(fileName);
 }
 
 QString PeruseConfig::getFilesystemProperty(QString fileName, QString propertyName)
@@ -51,6 +51,12 @@ class PeruseConfig : public QObject
      * \brief boolean representing whether or not we should animate jumps on the page
      */
     Q_PROPERTY(bool animateJumpAreas READ animateJumpAreas WRITE setAnimateJumpAreas NOTIFY animateJumpAreasChanged)
+    /**
+     * \brief How much space, in MiB, the cache of book covers may take up on disk
+     *
+     * The cache is only resized when Peruse is next started.
+     */
+    Q_PROPERTY(int coverCacheSize READ coverCacheSize WRITE setCoverCacheSize NOTIFY coverCacheSizeChanged)
 public:
     /**
      * \brief Enum holding the preferred zoom mode.
@@ -123,6 +129,20 @@ public:
      */
     Q_SIGNAL void animateJumpAreasChanged();
 
+    /**
+     * @return the size of the book cover cache in MiB
+     */
+    int coverCacheSize() const;
+    /**
+     * \brief Set the size of the book cover cache
+     * @param megabytes the new size of the cover cache in MiB
+     */
+    void setCoverCacheSize(int megabytes);
+    /**
+     * \brief Fires when the coverCacheSize property gets changed
+     */
+    Q_SIGNAL void coverCacheSizeChanged();
+
     /**
      * \brief Fires when there is an config error message to show.
      * @param message The Error message to show.
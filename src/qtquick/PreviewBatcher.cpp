@@ -0,0 +1,243 @@
+// SPDX-FileCopyrightText: 2026 Peruse contributors
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "PreviewBatcher.h"
+
+#include "ThumbnailStore.h"
+
+#include <KFileItem>
+#include <kio/previewjob.h>
+
+#include <QCoreApplication>
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QPixmap>
+#include <QSet>
+#include <QThread>
+#include <QTimer>
+
+#include <qtquick_debug.h>
+
+#include <algorithm>
+
+namespace
+{
+// How long to wait for more requests to turn up before starting a job
+constexpr int batchWindow = 25;
+// How long a job may go without making a single preview before it is given up on
+constexpr int stallTimeout = 3000;
+
+struct Request {
+    quint64 ticket{0};
+    QString fileName;
+    QString mimetype;
+    int size{0};
+    std::function<void(const QImage &, bool)> done;
+};
+
+struct InFlight {
+    KIO::PreviewJob *job{nullptr};
+    QString fileName;
+    std::function<void(const QImage &, bool)> done;
+};
+}
+
+class PreviewBatcher::Private
+{
+public:
+    Private(PreviewBatcher *qq)
+        : q(qq)
+    {
+    }
+    PreviewBatcher *q;
+    QTimer *batchTimer{nullptr};
+
+    QMutex mutex;
+    quint64 nextTicket{1};
+    QList<Request> pending;
+    QHash<quint64, InFlight> inFlight;
+    // The jobs which have not yet finished. This is only used on the batcher's thread.
+    QSet<KIO::PreviewJob *> jobs;
+
+    // Take the callbacks of all the requests for the given file in the given job (or for every
+    // file in the job, if the filename is empty). Must be called with the mutex held.
+    QList<std::function<void(const QImage &, bool)>> takeRequests(KIO::PreviewJob *job, const QString &fileName)
+    {
+        QList<std::function<void(const QImage &, bool)>> callbacks;
+        for (auto it = inFlight.begin(); it != inFlight.end();) {
+            if (it->job == job && (fileName.isEmpty() || it->fileName == fileName)) {
+                callbacks << it->done;
+                it = inFlight.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        return callbacks;
+    }
+
+    void complete(KIO::PreviewJob *job, const QString &fileName, const QImage &image, bool success)
+    {
+        QMutexLocker locker(&mutex);
+        const auto callbacks = takeRequests(job, fileName);
+        locker.unlock();
+        for (const auto &done : callbacks) {
+            done(image, success);
+        }
+    }
+
+    // Start one job for each size with everything which has been asked for since the last time
+    void startJobs()
+    {
+        static QStringList allPlugins{KIO::PreviewJob::availablePlugins()};
+
+        QMutexLocker locker(&mutex);
+        QMap<int, KFileItemList> itemsBySize;
+        QMap<int, QList<Request>> requestsBySize;
+        for (const Request &request : std::as_const(pending)) {
+            QList<Request> &sizeRequests = requestsBySize[request.size];
+            // Several requests for the same file only need the one preview
+            const bool alreadyListed = std::any_of(sizeRequests.cbegin(), sizeRequests.cend(), [&request](const Request &other) {
+                return other.fileName == request.fileName;
+            });
+            if (!alreadyListed) {
+                itemsBySize[request.size] << KFileItem(QUrl::fromLocalFile(request.fileName), request.mimetype, 0);
+            }
+            sizeRequests << request;
+        }
+        pending.clear();
+
+        for (auto it = itemsBySize.cbegin(); it != itemsBySize.cend(); ++it) {
+            KIO::PreviewJob *job = new KIO::PreviewJob(it.value(), QSize(it.key(), it.key()), &allPlugins);
+            job->setIgnoreMaximumSize(true);
+            job->setScaleType(KIO::PreviewJob::ScaledAndCached);
+            for (const Request &request : requestsBySize.value(it.key())) {
+                inFlight.insert(request.ticket, InFlight{job, request.fileName, request.done});
+            }
+            jobs.insert(job);
+
+            QTimer *stall = new QTimer(job);
+            stall->setSingleShot(true);
+            stall->setInterval(stallTimeout);
+            QObject::connect(stall, &QTimer::timeout, job, [job]() {
+                qCDebug(QTQUICK_LOG) << "Preview job stalled, giving up on the previews it has left to make";
+                job->kill();
+            });
+            QObject::connect(job, &KIO::PreviewJob::gotPreview, q, [this, job, stall](const KFileItem &item, const QPixmap &preview) {
+                stall->start();
+                complete(job, item.url().toLocalFile(), preview.toImage(), true);
+            });
+            QObject::connect(job, &KIO::PreviewJob::failed, q, [this, job, stall](const KFileItem &item) {
+                stall->start();
+                complete(job, item.url().toLocalFile(), QImage(), false);
+            });
+            // Emitted however the job ends, including when it is killed
+            QObject::connect(job, &KJob::finished, q, [this, job]() {
+                jobs.remove(job);
+                complete(job, QString(), QImage(), false);
+            });
+            stall->start();
+            job->start();
+        }
+    }
+
+    // Take a file out of a job, if nothing else wants its preview any longer
+    void dropFile(KIO::PreviewJob *job, const QString &fileName)
+    {
+        if (!jobs.contains(job)) {
+            return;
+        }
+        bool fileWanted{false};
+        bool jobWanted{false};
+        {
+            QMutexLocker locker(&mutex);
+            for (const InFlight &request : std::as_const(inFlight)) {
+                if (request.job == job) {
+                    jobWanted = true;
+                    if (request.fileName == fileName) {
+                        fileWanted = true;
+                        break;
+                    }
+                }
+            }
+        }
+        if (!jobWanted) {
+            job->kill();
+        } else if (!fileWanted) {
+            job->removeItem(QUrl::fromLocalFile(fileName));
+        }
+    }
+};
+
+PreviewBatcher *PreviewBatcher::instance()
+{
+    static PreviewBatcher *batcher = new PreviewBatcher();
+    return batcher;
+}
+
+PreviewBatcher::PreviewBatcher(QObject *parent)
+    : QObject(parent)
+    , d(new Private(this))
+{
+    d->batchTimer = new QTimer(this);
+    d->batchTimer->setSingleShot(true);
+    d->batchTimer->setInterval(batchWindow);
+    connect(d->batchTimer, &QTimer::timeout, this, [this]() {
+        d->startJobs();
+    });
+    // The jobs need an event loop, and the batcher may well be first used from a worker thread
+    moveToThread(QCoreApplication::instance()->thread());
+}
+
+PreviewBatcher::~PreviewBatcher()
+{
+    delete d;
+}
+
+quint64 PreviewBatcher::preview(const QString &fileName, const QString &mimetype, const QSize &size, const std::function<void(const QImage &, bool)> &done)
+{
+    QMutexLocker locker(&d->mutex);
+    const quint64 ticket = d->nextTicket++;
+    const bool wasEmpty = d->pending.isEmpty();
+    d->pending << Request{ticket, fileName, mimetype, ThumbnailStore::sizeFor(size), done};
+    if (wasEmpty) {
+        QMetaObject::invokeMethod(
+            this,
+            [this]() {
+                d->batchTimer->start();
+            },
+            Qt::QueuedConnection);
+    }
+    return ticket;
+}
+
+void PreviewBatcher::cancel(quint64 ticket)
+{
+    std::function<void(const QImage &, bool)> done;
+    {
+        QMutexLocker locker(&d->mutex);
+        for (int i = 0; i < d->pending.count(); ++i) {
+            if (d->pending.at(i).ticket == ticket) {
+                done = d->pending.takeAt(i).done;
+                break;
+            }
+        }
+        if (!done) {
+            const InFlight request = d->inFlight.take(ticket);
+            if (request.job) {
+                done = request.done;
+                KIO::PreviewJob *job = request.job;
+                const QString fileName = request.fileName;
+                QMetaObject::invokeMethod(
+                    this,
+                    [this, job, fileName]() {
+                        d->dropFile(job, fileName);
+                    },
+                    Qt::QueuedConnection);
+            }
+        }
+    }
+    if (done) {
+        done(QImage(), false);
+    }
+}
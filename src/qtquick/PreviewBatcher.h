@@ -0,0 +1,62 @@
+// SPDX-FileCopyrightText: 2026 Peruse contributors
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#ifndef PREVIEWBATCHER_H
+#define PREVIEWBATCHER_H
+
+#include <QImage>
+#include <QObject>
+#include <QSize>
+
+#include <functional>
+
+/**
+ * \brief Gathers up requests for file previews into as few KIO::PreviewJobs as possible
+ *
+ * Each preview job has to set up its KIO workers before it can make any previews, which for a
+ * single file takes much longer than making the preview itself. Requests which arrive within a
+ * short time of each other are gathered up, and handed to one job for each of the thumbnail
+ * store's sizes, and the previews are handed back to each request as the job makes them.
+ *
+ * Requests can be made from any thread, but the jobs themselves run on the thread the
+ * application lives in.
+ */
+class PreviewBatcher : public QObject
+{
+    Q_OBJECT
+public:
+    /**
+     * @return The batcher shared by everything which needs file previews
+     */
+    static PreviewBatcher *instance();
+    ~PreviewBatcher() override;
+
+    /**
+     * \brief Ask for a preview of a file
+     *
+     * @param fileName The local filename of the file
+     * @param mimetype The mimetype of the file
+     * @param size The size the preview is wanted at. The preview is made at the thumbnail store's
+     * size for this (see ThumbnailStore::sizeFor()), and so may be larger than this.
+     * @param done Called once the preview has been made, with the preview and true, or with a null
+     * image and false if no preview could be made. This is called exactly once for each request,
+     * including when the request is cancelled.
+     * @return A ticket identifying the request, for use with cancel()
+     */
+    quint64 preview(const QString &fileName, const QString &mimetype, const QSize &size, const std::function<void(const QImage &, bool)> &done);
+    /**
+     * \brief Cancel a request
+     *
+     * The request's callback is called straight away, and if no other request wants a
+     * preview of the same file, the file is taken out of its job.
+     * @param ticket The ticket of the request to cancel
+     */
+    void cancel(quint64 ticket);
+
+private:
+    explicit PreviewBatcher(QObject *parent = nullptr);
+    class Private;
+    Private *d;
+};
+
+#endif // PREVIEWBATCHER_H
@@ -20,9 +20,12 @@
  */
 
 #include "PreviewImageProvider.h"
+#include "CoverAtlas.h"
+#include "PreviewBatcher.h"
+#include "ThumbnailScheduler.h"
 
+#include <KFileItem>
 #include <kiconloader.h>
-#include <kio/previewjob.h>
 
 #include <QCoreApplication>
 #include <QDebug>
@@ -30,8 +33,6 @@
 #include <QIcon>
 #include <QMimeDatabase>
 #include <QMutex>
-#include <QThreadPool>
-#include <QTimer>
 
 class PreviewImageProvider::Private
 {
@@ -60,7 +61,11 @@ public:
         m_runnable->setAutoDelete(false);
         connect(m_runnable, &PreviewRunnable::done, this, &PreviewResponse::handleDone, Qt::QueuedConnection);
         connect(this, &QQuickImageResponse::finished, m_runnable, &QObject::deleteLater, Qt::QueuedConnection);
-        QThreadPool::globalInstance()->start(m_runnable);
+        PreviewRunnable *runnable = m_runnable;
+        // Both waiting on another process and reading the file are mostly waiting, so this all counts as reading
+        m_ticket = ThumbnailScheduler::instance()->schedule(id, ThumbnailScheduler::ReadStage, [runnable](quint64) {
+            runnable->run();
+        });
     }
 
     void handleDone(QImage image)
@@ -76,10 +81,16 @@ public:
 
     void cancel() override
     {
-        m_runnable->abort();
+        // Work which never started can simply be dropped, anything else has to be told to stop
+        if (ThumbnailScheduler::instance()->cancel(m_ticket)) {
+            Q_EMIT finished();
+        } else {
+            m_runnable->abort();
+        }
     }
 
     PreviewRunnable *m_runnable{nullptr};
+    quint64 m_ticket{0};
     QImage m_image;
 };
 
@@ -104,6 +115,8 @@ public:
     QSize requestedSize;
 
     bool abort{false};
+    // The batcher's request for the preview, if one has been made
+    quint64 ticket{0};
     QMutex abortMutex;
     bool isAborted()
     {
@@ -112,7 +125,6 @@ public:
     }
 
     QImage preview;
-    QPointer<KIO::PreviewJob> job{nullptr};
     QString mimetype;
 };
 
@@ -125,7 +137,6 @@ PreviewRunnable::PreviewRunnable(const QString &id, const QSize &requestedSize)
 
 PreviewRunnable::~PreviewRunnable()
 {
-    abort();
     delete d;
 }
 
@@ -143,74 +154,60 @@ void PreviewRunnable::run()
             d->mimetype = mimetypes.first().name();
         }
 
-        if (!d->isAborted()) {
-            static QStringList allPlugins{KIO::PreviewJob::availablePlugins()};
-            d->job = new KIO::PreviewJob(KFileItemList() << KFileItem(QUrl::fromLocalFile(d->id), d->mimetype, 0), ourSize, &allPlugins);
-            d->job->setIgnoreMaximumSize(true);
-            d->job->setScaleType(KIO::PreviewJob::ScaledAndCached);
-            connect(d->job, &KIO::PreviewJob::gotPreview, this, &PreviewRunnable::updatePreview);
-            connect(d->job, &KIO::PreviewJob::failed, this, &PreviewRunnable::fallbackPreview);
-            connect(d->job, &KIO::PreviewJob::finished, this, &PreviewRunnable::finishedPreview);
-            d->job->start();
-
-            QTimer *breaker = new QTimer();
-            breaker->moveToThread(thread());
-            breaker->setParent(this);
-            breaker->setSingleShot(true);
-            breaker->setInterval(3000);
-            connect(breaker, &QTimer::timeout, this, [this]() {
-                if (!d->isAborted()) {
-                    abort();
-                }
-            });
-            QTimer::singleShot(0, breaker, [breaker]() {
-                breaker->start();
+        QMutexLocker locker(&d->abortMutex);
+        if (!d->abort) {
+            // The preview is made at no less than the atlas size, so the atlas gets a cover which looks right on the shelves
+            const QSize previewSize = ourSize.expandedTo(QSize(CoverAtlas::maximumCoverSize(), CoverAtlas::maximumCoverSize()));
+            d->ticket = PreviewBatcher::instance()->preview(d->id, d->mimetype, previewSize, [this, ourSize](const QImage &preview, bool success) {
+                // This is called on the application's thread, so leave the scaling to the scheduler
+                ThumbnailScheduler::instance()->schedule(d->id, ThumbnailScheduler::DecodeStage, [this, ourSize, preview, success](quint64) {
+                    if (success) {
+                        CoverAtlas::instance()->insert(d->id, preview);
+                        d->preview = preview;
+                        if (preview.width() > ourSize.width() || preview.height() > ourSize.height()) {
+                            d->preview = preview.scaled(ourSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+                        }
+                    } else {
+                        fallbackPreview();
+                    }
+                    finishedPreview();
+                });
             });
         } else {
-            finishedPreview(nullptr);
+            locker.unlock();
+            finishedPreview();
         }
     } else {
-        finishedPreview(nullptr);
+        finishedPreview();
     }
 }
 
 void PreviewRunnable::abort()
 {
-    if (d->job) {
+    quint64 ticket{0};
+    {
         QMutexLocker locker(&d->abortMutex);
         d->abort = true;
-        locker.unlock();
-        d->job->kill();
+        ticket = d->ticket;
     }
-}
-
-void PreviewRunnable::fallbackPreview(const KFileItem &item)
-{
-    KIO::PreviewJob *previewJob = qobject_cast<KIO::PreviewJob *>(sender());
-    if (previewJob) {
-        QMimeDatabase db;
-        QIcon mimeIcon = QIcon::fromTheme(db.mimeTypeForName(item.mimetype()).iconName());
-        QSize actualSize = mimeIcon.actualSize(d->requestedSize);
-        d->preview = mimeIcon.pixmap(actualSize).toImage();
+    if (ticket > 0) {
+        PreviewBatcher::instance()->cancel(ticket);
     }
 }
 
-void PreviewRunnable::updatePreview(const KFileItem &, const QPixmap &p)
+void PreviewRunnable::fallbackPreview()
 {
-    KIO::PreviewJob *previewJob = qobject_cast<KIO::PreviewJob *>(sender());
-    if (previewJob) {
-        d->preview = p.toImage();
-    }
+    QMimeDatabase db;
+    QIcon mimeIcon = QIcon::fromTheme(db.mimeTypeForName(d->mimetype).iconName());
+    QSize actualSize = mimeIcon.actualSize(d->requestedSize);
+    d->preview = mimeIcon.pixmap(actualSize).toImage();
 }
 
-void PreviewRunnable::finishedPreview(KJob * /*job*/)
+void PreviewRunnable::finishedPreview()
 {
     if (d->isAborted()) {
         if (d->preview.isNull()) {
-            QMimeDatabase db;
-            QIcon mimeIcon = QIcon::fromTheme(db.mimeTypeForName(d->mimetype).iconName());
-            QSize actualSize = mimeIcon.actualSize(d->requestedSize);
-            d->preview = mimeIcon.pixmap(actualSize).toImage();
+            fallbackPreview();
         }
     } else {
         if (d->requestedSize.width() > 0 && d->requestedSize.height() > 0) {
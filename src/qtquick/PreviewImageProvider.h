@@ -28,10 +28,11 @@
 /**
  * \brief Get file previews using KIO::PreviewJob
  *
+ * Requests are handed to PreviewBatcher, which gathers up those arriving close together into
+ * shared preview jobs.
+ *
  * NOTE: As this task is potentially heavy, make sure to mark any Image using this provider asynchronous
  */
-class KFileItem;
-class KJob;
 class PreviewImageProvider : public QQuickAsyncImageProvider
 {
 public:
@@ -76,26 +77,17 @@ public:
      * @param image The preview image in the requested size (possibly a placeholder)
      */
     Q_SIGNAL void done(QImage image);
+
+private:
     /**
-     *\brief Get an icon associated with the mimetype of the image as a fallback.
-     *
-     * @param p Pointer to pixmap to write this fallback into.
-     */
-    Q_SLOT void updatePreview(const KFileItem &, const QPixmap &p);
-    /**
-     *\brief Get an icon associated with the mimetype of the image as a fallback.
-     *
-     * @param item The image to write a fallback for.
+     * \brief Use the icon for the file's mimetype as the preview, for when no real preview could be made
      */
-    Q_SLOT void fallbackPreview(const KFileItem &item);
+    void fallbackPreview();
     /**
-     * \brief Set whether the preview generation is finished.
-     *
-     * @param job The job to mark finished.
+     * \brief Scale the preview to the requested size, and hand it on through done()
      */
-    Q_SLOT void finishedPreview(KJob *job);
+    void finishedPreview();
 
-private:
     class Private;
     Private *d;
 };
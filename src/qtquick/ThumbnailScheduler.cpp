@@ -0,0 +1,197 @@
+// SPDX-FileCopyrightText: 2026 Peruse contributors
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "ThumbnailScheduler.h"
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QSet>
+#include <QThread>
+#include <QThreadPool>
+
+#include <array>
+
+namespace
+{
+struct Job {
+    quint64 ticket{0};
+    QString id;
+    std::function<void(quint64)> work;
+};
+
+struct Lane {
+    // One queue for each priority. New jobs go at the back, and the back is taken first.
+    std::array<QList<Job>, 3> queues;
+    int running{0};
+    int maxRunning{1};
+};
+}
+
+class ThumbnailScheduler::Private
+{
+public:
+    Private(ThumbnailScheduler *qq)
+        : q(qq)
+    {
+        const int cores = qMax(1, QThread::idealThreadCount());
+        // Reading is mostly waiting, so more of it can happen at once than there are cores
+        lanes[ReadStage].maxRunning = qMax(4, cores);
+        lanes[DecodeStage].maxRunning = cores;
+        pool.setMaxThreadCount(lanes[ReadStage].maxRunning + lanes[DecodeStage].maxRunning);
+    }
+    ThumbnailScheduler *q;
+    QThreadPool pool;
+
+    mutable QMutex mutex;
+    std::array<Lane, 2> lanes;
+    quint64 nextTicket{1};
+    // The image id and priority of each job which has been scheduled and not yet finished, by ticket
+    QHash<quint64, QPair<QString, Priority>> jobs;
+    // Jobs whose work has moved on to another stage while running
+    QSet<quint64> continued;
+    // The priorities set for images through setPriority(), other than Visible
+    QHash<QString, Priority> priorities;
+
+    void enqueue(Stage stage, Priority priority, Job &&job)
+    {
+        lanes[stage].queues[priority].append(std::move(job));
+        dispatch(stage);
+    }
+
+    // Must be called with the mutex held
+    void dispatch(Stage stage)
+    {
+        Lane &lane = lanes[stage];
+        while (lane.running < lane.maxRunning) {
+            QList<Job> *queue = nullptr;
+            for (QList<Job> &candidate : lane.queues) {
+                if (!candidate.isEmpty()) {
+                    queue = &candidate;
+                    break;
+                }
+            }
+            if (!queue) {
+                return;
+            }
+            Job job = queue->takeLast();
+            ++lane.running;
+            pool.start([this, stage, job]() {
+                job.work(job.ticket);
+                QMutexLocker locker(&mutex);
+                --lanes[stage].running;
+                if (!continued.remove(job.ticket)) {
+                    jobs.remove(job.ticket);
+                }
+                dispatch(stage);
+            });
+        }
+    }
+};
+
+ThumbnailScheduler *ThumbnailScheduler::instance()
+{
+    static ThumbnailScheduler *scheduler = new ThumbnailScheduler();
+    return scheduler;
+}
+
+ThumbnailScheduler::ThumbnailScheduler(QObject *parent)
+    : QObject(parent)
+    , d(new Private(this))
+{
+}
+
+ThumbnailScheduler::~ThumbnailScheduler()
+{
+    {
+        QMutexLocker locker(&d->mutex);
+        for (Lane &lane : d->lanes) {
+            for (QList<Job> &queue : lane.queues) {
+                queue.clear();
+            }
+        }
+    }
+    d->pool.waitForDone();
+    delete d;
+}
+
+quint64 ThumbnailScheduler::schedule(const QString &id, Stage stage, const std::function<void(quint64)> &work)
+{
+    QMutexLocker locker(&d->mutex);
+    const Priority priority = d->priorities.value(id, Visible);
+    const quint64 ticket = d->nextTicket++;
+    d->jobs.insert(ticket, qMakePair(id, priority));
+    d->enqueue(stage, priority, Job{ticket, id, work});
+    return ticket;
+}
+
+void ThumbnailScheduler::continueWith(quint64 ticket, Stage stage, const std::function<void(quint64)> &work)
+{
+    QMutexLocker locker(&d->mutex);
+    const auto it = d->jobs.constFind(ticket);
+    if (it == d->jobs.constEnd()) {
+        // Cancelled in the meantime
+        return;
+    }
+    d->continued.insert(ticket);
+    d->enqueue(stage, it->second, Job{ticket, it->first, work});
+}
+
+bool ThumbnailScheduler::cancel(quint64 ticket)
+{
+    QMutexLocker locker(&d->mutex);
+    for (Lane &lane : d->lanes) {
+        for (QList<Job> &queue : lane.queues) {
+            for (int i = 0; i < queue.count(); ++i) {
+                if (queue.at(i).ticket == ticket) {
+                    queue.removeAt(i);
+                    d->jobs.remove(ticket);
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+void ThumbnailScheduler::setPriority(const QString &id, ThumbnailScheduler::Priority priority)
+{
+    QMutexLocker locker(&d->mutex);
+    if (priority == Visible) {
+        d->priorities.remove(id);
+    } else {
+        d->priorities.insert(id, priority);
+    }
+    for (int stage = 0; stage < int(d->lanes.size()); ++stage) {
+        Lane &lane = d->lanes[stage];
+        QList<Job> moved;
+        for (int queuePriority = 0; queuePriority < int(lane.queues.size()); ++queuePriority) {
+            if (queuePriority == priority) {
+                continue;
+            }
+            QList<Job> &queue = lane.queues[queuePriority];
+            for (int i = queue.count() - 1; i >= 0; --i) {
+                if (queue.at(i).id == id) {
+                    d->jobs[queue.at(i).ticket].second = priority;
+                    moved.prepend(queue.takeAt(i));
+                }
+            }
+        }
+        // Moved jobs count as freshly requested at their new priority
+        lane.queues[priority].append(moved);
+    }
+}
+
+void ThumbnailScheduler::setMaxRunning(Stage stage, int maxRunning)
+{
+    QMutexLocker locker(&d->mutex);
+    d->lanes[stage].maxRunning = qMax(1, maxRunning);
+    d->pool.setMaxThreadCount(d->lanes[ReadStage].maxRunning + d->lanes[DecodeStage].maxRunning);
+    d->dispatch(stage);
+}
+
+int ThumbnailScheduler::maxRunning(Stage stage) const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->lanes[stage].maxRunning;
+}
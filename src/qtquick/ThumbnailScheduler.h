@@ -0,0 +1,118 @@
+// SPDX-FileCopyrightText: 2026 Peruse contributors
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#ifndef THUMBNAILSCHEDULER_H
+#define THUMBNAILSCHEDULER_H
+
+#include <QObject>
+#include <QString>
+
+#include <functional>
+
+/**
+ * \brief Runs the work for the thumbnail image providers, most wanted thumbnails first
+ *
+ * Work is queued by priority, and within each priority the most recently requested work
+ * runs first, as when scrolling quickly through a shelf, the most recent requests are the
+ * ones for the covers actually on screen. Work which has not yet started can be taken back
+ * out of the queue entirely, rather than just being told to stop once it gets to run.
+ *
+ * Each job belongs to a stage, either reading (waiting on the disk, or on some other process)
+ * or decoding (busy on the processor), and each stage has its own limit on how many of its jobs
+ * may run at the same time. A job may move on to a later stage, keeping its place in the
+ * priorities, through continueWith().
+ *
+ * The scheduler is exposed to QML as ThumbnailScheduler, so views can raise or lower the
+ * priority of the images they have requested as they scroll (see BookCover in the app, which
+ * does this for the covers on the shelves). The priority an image is given is remembered,
+ * and used for work queued for it later on, as the view may well get to say how soon it wants
+ * an image before the image provider gets to queue up the work for it.
+ */
+class ThumbnailScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    /**
+     * How soon a thumbnail is wanted
+     */
+    enum Priority {
+        Visible = 0, ///< Currently shown on screen
+        NearViewport, ///< Just outside the view, and likely to be scrolled to next
+        Speculative, ///< Might be wanted at some point
+    };
+    Q_ENUM(Priority)
+
+    /**
+     * What a job spends its time doing
+     */
+    enum Stage {
+        ReadStage = 0, ///< Reading from disk, or waiting on another process
+        DecodeStage, ///< Decoding or scaling images
+    };
+    Q_ENUM(Stage)
+
+    /**
+     * @return The scheduler shared by all the thumbnail image providers
+     */
+    static ThumbnailScheduler *instance();
+    ~ThumbnailScheduler() override;
+
+    /**
+     * \brief Queue up some work
+     *
+     * @param id The id of the image the work is for, as passed to the image provider
+     * @param stage The stage the work belongs to
+     * @param work The work to do. This is run on a worker thread, and is passed the ticket of the job.
+     * @return A ticket identifying the job, for use with cancel() and continueWith(). The job is
+     * given the priority last set for the image, or Visible if none has been.
+     */
+    quint64 schedule(const QString &id, Stage stage, const std::function<void(quint64)> &work);
+    /**
+     * \brief Queue up the next stage of a job
+     *
+     * Call this from the job's work to have further work done in another stage. The new work
+     * takes over the job's ticket and priority.
+     *
+     * @param ticket The ticket of the job
+     * @param stage The stage the next part of the work belongs to
+     * @param work The next part of the work
+     */
+    void continueWith(quint64 ticket, Stage stage, const std::function<void(quint64)> &work);
+    /**
+     * \brief Take a job out of the queue
+     *
+     * @param ticket The ticket of the job to cancel
+     * @return True if the job had not yet started, and will now never run. If false, the job is
+     * already running (or done), and must be stopped by some other means.
+     */
+    bool cancel(quint64 ticket);
+
+    /**
+     * \brief Change the priority of all the queued work for an image, and of any work queued for it later
+     *
+     * Setting an image back to Visible also forgets about it, so do that once the image is no
+     * longer shown at all.
+     *
+     * @param id The id of the image, as passed to the image provider (that is, without the image://provider/ part)
+     * @param priority How soon the image is now wanted
+     */
+    Q_INVOKABLE void setPriority(const QString &id, ThumbnailScheduler::Priority priority);
+
+    /**
+     * \brief Set how many jobs in a stage may run at the same time
+     * @param stage The stage to set the limit for
+     * @param maxRunning The largest number of jobs which may run at once
+     */
+    void setMaxRunning(Stage stage, int maxRunning);
+    /**
+     * @return The largest number of jobs in the given stage which may run at once
+     */
+    int maxRunning(Stage stage) const;
+
+private:
+    explicit ThumbnailScheduler(QObject *parent = nullptr);
+    class Private;
+    Private *d;
+};
+
+#endif // THUMBNAILSCHEDULER_H
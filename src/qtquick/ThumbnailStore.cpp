@@ -0,0 +1,187 @@
+// SPDX-FileCopyrightText: 2026 Peruse contributors
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#include "ThumbnailStore.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QUrl>
+
+#include <qtquick_debug.h>
+
+namespace
+{
+QString thumbnailsDir()
+{
+    static const QString dir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QStringLiteral("/thumbnails");
+    return dir;
+}
+
+QString sizeDirName(int size)
+{
+    switch (size) {
+    case 128:
+        return QStringLiteral("normal");
+    case 256:
+        return QStringLiteral("large");
+    case 512:
+        return QStringLiteral("x-large");
+    default:
+        return QStringLiteral("xx-large");
+    }
+}
+
+// The specification wants the fully encoded URI, but some thumbnailers have stored the decoded
+// form in the past, so look for both when finding thumbnails (and only ever store the first)
+QStringList urisFor(const QString &fileName)
+{
+    const QUrl url = QUrl::fromLocalFile(QFileInfo(fileName).absoluteFilePath());
+    QStringList uris{url.toString(QUrl::FullyEncoded)};
+    const QString decoded = url.toString();
+    if (decoded != uris.first()) {
+        uris << decoded;
+    }
+    return uris;
+}
+
+QString thumbnailPath(const QString &uri, const QString &dirName)
+{
+    const QString hash = QString::fromLatin1(QCryptographicHash::hash(uri.toUtf8(), QCryptographicHash::Md5).toHex());
+    return QStringLiteral("%1/%2/%3.png").arg(thumbnailsDir(), dirName, hash);
+}
+
+QString thumbnailPath(const QString &uri, int size)
+{
+    return thumbnailPath(uri, sizeDirName(size));
+}
+
+QString failurePath(const QString &fileName)
+{
+    return thumbnailPath(urisFor(fileName).first(), QStringLiteral("fail/peruse"));
+}
+
+// Write a thumbnail, along with the text chunks which tie it to the file it was made from
+bool writeThumbnail(const QString &path, const QFileInfo &info, const QString &uri, const QImage &thumbnail)
+{
+    const QString dirPath = QFileInfo(path).absolutePath();
+    if (!QDir().mkpath(dirPath)) {
+        return false;
+    }
+    // The specification asks for the directories and thumbnails to only be readable by their owner
+    QFile::setPermissions(dirPath, QFileDevice::ReadOwner | QFileDevice::WriteOwner | QFileDevice::ExeOwner);
+
+    // QSaveFile writes to a temporary file and renames it into place, so other applications
+    // never see a partially written thumbnail, as the specification requires
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner);
+    QImageWriter writer(&file, "png");
+    writer.setText(QStringLiteral("Thumb::URI"), uri);
+    writer.setText(QStringLiteral("Thumb::MTime"), QString::number(info.lastModified().toSecsSinceEpoch()));
+    writer.setText(QStringLiteral("Thumb::Size"), QString::number(info.size()));
+    writer.setText(QStringLiteral("Software"), QStringLiteral("Peruse"));
+    if (!writer.write(thumbnail)) {
+        qCDebug(QTQUICK_LOG) << "Failed to write thumbnail for" << info.filePath() << writer.errorString();
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+}
+
+QList<int> ThumbnailStore::sizes()
+{
+    return {128, 256, 512, 1024};
+}
+
+int ThumbnailStore::sizeFor(const QSize &size)
+{
+    const int longEdge = qMax(size.width(), size.height());
+    const QList<int> storeSizes = sizes();
+    for (int storeSize : storeSizes) {
+        if (storeSize >= longEdge) {
+            return storeSize;
+        }
+    }
+    return storeSizes.last();
+}
+
+QImage ThumbnailStore::find(const QString &fileName, int size)
+{
+    QImage image;
+    const QFileInfo info(fileName);
+    if (!info.exists()) {
+        return image;
+    }
+    const QString mtime = QString::number(info.lastModified().toSecsSinceEpoch());
+    const QStringList uris = urisFor(fileName);
+    const QList<int> storeSizes = sizes();
+    for (int storeSize : storeSizes) {
+        if (storeSize < size) {
+            continue;
+        }
+        for (const QString &uri : uris) {
+            const QString path = thumbnailPath(uri, storeSize);
+            if (!QFile::exists(path)) {
+                continue;
+            }
+            // The text chunks come before the image data, so checking them does not decode anything
+            QImageReader reader(path, "png");
+            if (reader.text(QStringLiteral("Thumb::URI")) != uri || reader.text(QStringLiteral("Thumb::MTime")) != mtime) {
+                continue;
+            }
+            if (reader.read(&image)) {
+                return image;
+            }
+        }
+    }
+    return image;
+}
+
+bool ThumbnailStore::store(const QString &fileName, const QImage &image, int size)
+{
+    const QFileInfo info(fileName);
+    // Thumbnails of thumbnails would only ever be clutter
+    if (image.isNull() || !info.exists() || info.absoluteFilePath().startsWith(thumbnailsDir())) {
+        return false;
+    }
+
+    QImage thumbnail = image;
+    if (qMax(image.width(), image.height()) > size) {
+        thumbnail = image.scaled(size, size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+    const QString uri = urisFor(fileName).first();
+    return writeThumbnail(thumbnailPath(uri, size), info, uri, thumbnail);
+}
+
+bool ThumbnailStore::storeFailure(const QString &fileName)
+{
+    const QFileInfo info(fileName);
+    if (!info.exists() || info.absoluteFilePath().startsWith(thumbnailsDir())) {
+        return false;
+    }
+    // The failure is recorded as an empty image carrying the same details as a thumbnail would
+    QImage empty(1, 1, QImage::Format_ARGB32);
+    empty.fill(Qt::transparent);
+    return writeThumbnail(failurePath(fileName), info, urisFor(fileName).first(), empty);
+}
+
+bool ThumbnailStore::hasFailed(const QString &fileName)
+{
+    const QFileInfo info(fileName);
+    const QString path = failurePath(fileName);
+    if (!info.exists() || !QFile::exists(path)) {
+        return false;
+    }
+    QImageReader reader(path, "png");
+    return reader.text(QStringLiteral("Thumb::URI")) == urisFor(fileName).first()
+        && reader.text(QStringLiteral("Thumb::MTime")) == QString::number(info.lastModified().toSecsSinceEpoch());
+}
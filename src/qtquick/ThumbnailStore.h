@@ -0,0 +1,77 @@
+// SPDX-FileCopyrightText: 2026 Peruse contributors
+// SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+
+#ifndef THUMBNAILSTORE_H
+#define THUMBNAILSTORE_H
+
+#include <QImage>
+#include <QList>
+#include <QSize>
+#include <QString>
+
+/**
+ * \brief The thumbnails shared with other applications, following the freedesktop thumbnail specification
+ *
+ * File managers such as Dolphin store the thumbnails they make in ~/.cache/thumbnails, in one
+ * directory for each size, named by the MD5 sum of the file's URI. Each thumbnail records the URI and
+ * modification time of the file it was made from, and is only used while both still match.
+ * Looking here first means a book someone has already browsed to in their file manager does not
+ * have to be opened to show its cover, and storing the covers Peruse makes here saves the file
+ * manager the same work.
+ *
+ * @see https://specifications.freedesktop.org/thumbnail-spec/latest/
+ */
+class ThumbnailStore
+{
+public:
+    /**
+     * @return The sizes the store holds thumbnails at (the normal, large, x-large and xx-large
+     * sizes of the specification), smallest first
+     */
+    static QList<int> sizes();
+    /**
+     * @param size The size a thumbnail is wanted at
+     * @return The smallest of the store's sizes which is at least as large, or the largest
+     * of them if none are
+     */
+    static int sizeFor(const QSize &size);
+
+    /**
+     * \brief Find a thumbnail for a file
+     *
+     * This looks for a valid thumbnail at the given size, and failing that, at the larger sizes.
+     * Only the thumbnails are read, the file itself is not touched beyond looking at its modification time.
+     *
+     * @param fileName The local filename of the file
+     * @param size One of the store's sizes
+     * @return The thumbnail, or a null image if there is no up to date one which is at least this large
+     */
+    static QImage find(const QString &fileName, int size);
+    /**
+     * \brief Store a thumbnail for a file
+     *
+     * @param fileName The local filename of the file the thumbnail was made from
+     * @param image The thumbnail. If this is larger than the size it is stored at, it is scaled down.
+     * @param size One of the store's sizes
+     * @return True if the thumbnail was stored
+     */
+    static bool store(const QString &fileName, const QImage &image, int size);
+
+    /**
+     * \brief Record that no thumbnail could be made for a file
+     *
+     * As the specification asks, this goes into Peruse's own directory under fail/, so other
+     * applications are free to try for themselves.
+     *
+     * @param fileName The local filename of the file
+     * @return True if the failure was recorded
+     */
+    static bool storeFailure(const QString &fileName);
+    /**
+     * @param fileName The local filename of the file
+     * @return True if making a thumbnail for the file has failed before, and the file has not changed since
+     */
+    static bool hasFailed(const QString &fileName);
+};
+
+#endif // THUMBNAILSTORE_H
@@ -23,6 +23,11 @@
 #include "KRarFileEntry.h"
 
 #include <QDebug>
+#include <QHash>
+#include <QMutex>
+#include <QTemporaryFile>
+#include <QThread>
+#include <QWaitCondition>
 #include <QtCore/QDir>
 #include <QtCore/QFile>
 #include <QtCore/QIODevice>
@@ -42,6 +47,98 @@ public:
     ar_archive *archive;
     ar_stream *stream;
     QList<KRarFileEntry *> files;
+
+    bool solid{false};
+    bool spooling{false};
+    // Everything below is the spool of a solid archive's decompressed entries, guarded by the mutex
+    QMutex spoolMutex;
+    QWaitCondition spoolProgress;
+    QThread *spooler{nullptr};
+    bool abortSpooling{false};
+    bool spoolingDone{false};
+    QTemporaryFile *spool{nullptr};
+    qint64 spoolEnd{0};
+    // The offset and size of each entry in the spool, by the offset of the entry's header in the archive
+    QHash<qint64, QPair<qint64, qint64>> spooled;
+
+    /**
+     * Whether the rar file is a solid archive. That is marked in the flags of the main archive header,
+     * which in RAR 1.5 to 4 (which is what unarr supports) comes straight after the marker block.
+     */
+    static bool isSolidRar(const QString &fileName)
+    {
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly)) {
+            return false;
+        }
+        // The marker block, followed by the header's crc16, type (0x73 for the main header) and flags
+        const QByteArray head = file.read(12);
+        if (head.size() < 12 || !head.startsWith(QByteArray("Rar!\x1a\x07\x00", 7)) || quint8(head.at(9)) != 0x73) {
+            return false;
+        }
+        const quint16 flags = quint8(head.at(10)) | (quint8(head.at(11)) << 8);
+        return flags & 0x0008;
+    }
+
+    // Runs on the spooler thread, with an archive handle of its own
+    void spoolArchive(const QString &fileName)
+    {
+        ar_stream *spoolStream = ar_open_file(fileName.toLocal8Bit());
+        ar_archive *spoolArchive = spoolStream ? ar_open_rar_archive(spoolStream) : nullptr;
+        QByteArray buffer;
+        while (spoolArchive && ar_parse_entry(spoolArchive)) {
+            {
+                QMutexLocker locker(&spoolMutex);
+                if (abortSpooling) {
+                    break;
+                }
+            }
+            const qint64 headerStart = ar_entry_get_offset(spoolArchive);
+            const qint64 size = ar_entry_get_size(spoolArchive);
+            buffer.resize(size);
+            if (size > 0 && !ar_entry_uncompress(spoolArchive, buffer.data(), size)) {
+                // Once one entry fails, the rest of the solid stream cannot be trusted either
+                qDebug() << "Failed to spool the solid archive" << fileName << "- the remaining entries will be read directly";
+                break;
+            }
+            QMutexLocker locker(&spoolMutex);
+            if (!spool->seek(spoolEnd) || spool->write(buffer) != size) {
+                qDebug() << "Failed to write to the spool for" << fileName << spool->errorString();
+                break;
+            }
+            spooled.insert(headerStart, qMakePair(spoolEnd, size));
+            spoolEnd += size;
+            spoolProgress.wakeAll();
+        }
+        if (spoolArchive) {
+            ar_close_archive(spoolArchive);
+        }
+        if (spoolStream) {
+            ar_close(spoolStream);
+        }
+        QMutexLocker locker(&spoolMutex);
+        spoolingDone = true;
+        spoolProgress.wakeAll();
+    }
+
+    void stopSpooling()
+    {
+        QMutexLocker locker(&spoolMutex);
+        abortSpooling = true;
+        locker.unlock();
+        if (spooler) {
+            spooler->wait();
+            delete spooler;
+            spooler = nullptr;
+        }
+        locker.relock();
+        delete spool;
+        spool = nullptr;
+        spooled.clear();
+        spoolEnd = 0;
+        abortSpooling = false;
+        spoolingDone = false;
+    }
 };
 
 KRar::KRar(const QString &filename)
@@ -137,6 +234,8 @@ bool KRar::openArchive(QIODevice::OpenMode mode)
         return false;
     }
 
+    d->solid = Private::isSolidRar(fileName());
+
     // Iterate through all entries and get a KRarFileEntry out of them
     while (ar_parse_entry(d->archive)) {
         QString pathname(ar_entry_get_name(d->archive));
@@ -186,6 +285,7 @@ bool KRar::openArchive(QIODevice::OpenMode mode)
 
 bool KRar::closeArchive()
 {
+    d->stopSpooling();
     ar_close_archive(d->archive);
     ar_close(d->stream);
     d->archive = nullptr;
@@ -195,6 +295,50 @@ bool KRar::closeArchive()
     return true;
 }
 
+bool KRar::isSolid() const
+{
+    return d->solid;
+}
+
+void KRar::setSpooling(bool spooling)
+{
+    d->spooling = spooling;
+}
+
+QByteArray KRar::spooledData(qint64 headerStart, bool *found) const
+{
+    QByteArray data;
+    *found = false;
+    if (!d->solid || !d->spooling) {
+        return data;
+    }
+
+    QMutexLocker locker(&d->spoolMutex);
+    if (!d->spool) {
+        // Nothing has been read yet, so get the spooler going
+        d->spool = new QTemporaryFile();
+        if (!d->spool->open()) {
+            qDebug() << "Failed to create a spool for the solid archive" << fileName() << d->spool->errorString();
+            d->spoolingDone = true;
+            return data;
+        }
+        const QString archiveFileName = fileName();
+        d->spooler = QThread::create([this, archiveFileName]() {
+            d->spoolArchive(archiveFileName);
+        });
+        d->spooler->start();
+    }
+    while (!d->spooled.contains(headerStart) && !d->spoolingDone) {
+        d->spoolProgress.wait(&d->spoolMutex);
+    }
+    const auto it = d->spooled.constFind(headerStart);
+    if (it != d->spooled.constEnd() && d->spool->seek(it->first)) {
+        data = d->spool->read(it->second);
+        *found = data.size() == it->second;
+    }
+    return data;
+}
+
 void KRar::virtual_hook(int id, void *data)
 {
     KArchive::virtual_hook(id, data);
@@ -56,6 +56,26 @@ public:
      */
     ~KRar() override;
 
+    /**
+     * Whether the archive is solid, that is, compressed as one continuous stream rather than
+     * entry by entry. Getting at any entry in a solid archive means decompressing every entry
+     * before it. Only valid once the archive has been opened.
+     * @see setSpooling
+     * @return True if the archive is solid
+     */
+    bool isSolid() const;
+
+    /**
+     * Rather than decompressing everything before an entry over again for each entry read from a
+     * solid archive, the first time an entry's data is asked for, the whole archive can be
+     * decompressed once in the background, with each entry kept in a temporary file as it goes
+     * past. Entry data is then served from there. This is only worth it for handles which will go
+     * on to read many of the entries, so it is off by default, and has no effect on archives which
+     * are not solid.
+     * @param spooling Whether to spool the archive
+     */
+    void setSpooling(bool spooling);
+
 protected:
     /*
      * Writing is not supported by this class, will always fail.
@@ -110,6 +130,17 @@ protected:
     void virtual_hook(int id, void *data) override;
 
 private:
+    friend class KRarFileEntry;
+    /**
+     * Fetch an entry's data from the solid archive spool, waiting for the entry to be
+     * decompressed if it has not been yet.
+     * @param headerStart The offset of the entry's header in the archive
+     * @param found Set to false if the entry could not be spooled (or the archive is not being spooled),
+     * in which case it must be read from the archive directly
+     * @return The data of the entry
+     */
+    QByteArray spooledData(qint64 headerStart, bool *found) const;
+
     class Private;
     Private *d;
 };
@@ -97,7 +97,13 @@ const QString &KRarFileEntry::path() const
 QByteArray KRarFileEntry::data() const
 {
     //     qDebug() << "Attempting to grab data from" << name() << "in" << path();
-    QByteArray data;
+    // Entries of spooled solid archives come from the spool, rather than decompressing everything before them again
+    bool spooled{false};
+    QByteArray data = d->rar->spooledData(d->headerStart, &spooled);
+    if (spooled) {
+        return data;
+    }
+    data.clear();
 
     ar_archive *archive = d->archive;
     QString pathname = QString("%1/%2").arg(path()).arg(name());
@@ -22,7 +22,9 @@
 #include "qmlplugin.h"
 
 #include "ComicCoverImageProvider.h"
+#include "CoverAtlasImageProvider.h"
 #include "PreviewImageProvider.h"
+#include "ThumbnailScheduler.h"
 #ifdef USE_PERUSE_PDFTHUMBNAILER
 #include "PDFCoverImageProvider.h"
 #endif
@@ -34,6 +36,7 @@ void QmlPlugins::initializeEngine(QQmlEngine *engine, const char *)
 {
     engine->addImageProvider("preview", new PreviewImageProvider());
     engine->addImageProvider("comiccover", new ComicCoverImageProvider());
+    engine->addImageProvider("atlascover", new CoverAtlasImageProvider());
 #ifdef USE_PERUSE_PDFTHUMBNAILER
     engine->addImageProvider("pdfcover", new PDFCoverImageProvider());
 #endif
@@ -41,4 +44,5 @@ void QmlPlugins::initializeEngine(QQmlEngine *engine, const char *)
 
 void QmlPlugins::registerTypes(const char *uri)
 {
+    qmlRegisterSingletonInstance(uri, 1, 0, "ThumbnailScheduler", ThumbnailScheduler::instance());
 }